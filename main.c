@@ -2,6 +2,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
 
 /* Constant definitions */
 
@@ -11,6 +26,18 @@
 #define DATA_SIZE 8
 #define generalPuproseRegister 64
 #define pipelineQueueSize 3
+#define VECTOR_LANES 8
+#define FIRST_POINTER_REGISTER 60
+#define BRANCH_FALL_THROUGH 3
+#define UNKNOWN_ADDRESS -2
+#define MAX_CORES 256
+#define DEFAULT_CORE_QUANTUM 100
+#define MEMO_MAX_ACCESSES 64
+#define DEFAULT_MEMO_ENTRIES 1024
+#define FUZZ_CYCLE_BUDGET 512
+#define FUZZ_MAP_SIZE 8192
+#define FUZZ_MAX_INPUT (1 + 255 * 2 + DATA_MEMORY_SIZE)
+#define FUZZ_CORPUS_SIZE 512
 
 /* Structures used in the implementations
     1. Register File. Structure that contains general puprose registers, status register and the PC register.
@@ -37,6 +64,7 @@ typedef struct
 typedef struct
 {
     char dataMemory[DATA_MEMORY_SIZE];
+    uint64_t dirty[DATA_MEMORY_SIZE / 64]; // one bit per byte written by a store or the loader.
 } dataMemory;
 
 typedef struct
@@ -76,21 +104,116 @@ typedef struct
     int rear;
 } toBeDecodedQueue;
 
+/* coreContext describes one simulated core when running in multicore mode. The cores are run by a pool of host
+   threads, each taking a share of the cores one quantum at a time, so in between quanta the thread local state of a
+   core is kept in coreState. The per-core results are copied here when the core finishes so main() can report them.
+*/
+
+typedef struct
+{
+    int numOfInstruction;
+    int clockCycle;
+    int pipelineControl;
+    long long instructionsExecuted;
+    pipelineStages instructionsStage;
+    registerFile regFile;
+    pipeLine pipeline;
+    toBeDecodedQueue toBeDecodedq;
+    toBeExecutedQueue toBeExecutedq;
+    short fetchedAddresses[pipelineQueueSize * 2];
+    int fetchedAddressCount;
+    short program[INSTRUCTION_MEMORY_SIZE];
+} coreState;
+
+typedef struct
+{
+    int id;
+    char *programPath;
+    bool finished;
+    long long cycles;
+    long long instructions;
+    double seconds;
+    registerFile finalRegisters;
+    coreState state;
+} coreContext;
+
 /*Global variables used to coordinate the execution. The execution should contain a single data memory structure,
 a single instruction memory structure, a single register file, and the queues are used as the pipeline blocks.
+Everything except the data memory is thread local, so each host thread running a simulated core has its own
+instruction memory, register file and pipeline. Cores reach the data memory through coreDataMem, which points to the
+shared dataMem unless the core was given a private one (the server workers).
 */
 
 char opcode;
-int numOfInstruction;
-int clockCycle = 1;
-int pipelineControl = 1;
-pipelineStages instructionsStage = {0, 0, 0, false, false};
-instructionMemory instMemory;
+_Thread_local int numOfInstruction;
+_Thread_local int clockCycle = 1;
+_Thread_local int pipelineControl = 1;
+_Thread_local long long instructionsExecuted = 0;
+_Thread_local pipelineStages instructionsStage = {0, 0, 0, false, false};
+_Thread_local instructionMemory instMemory;
 dataMemory dataMem;
-registerFile regFile;
-pipeLine pipeline;
-toBeDecodedQueue toBeDecodedq;
-toBeExecutedQueue toBeExecutedq;
+_Thread_local dataMemory *coreDataMem = &dataMem;
+_Thread_local registerFile regFile;
+_Thread_local pipeLine pipeline;
+_Thread_local toBeDecodedQueue toBeDecodedq;
+_Thread_local toBeExecutedQueue toBeExecutedq;
+
+/* Addresses of the instructions fetched but not executed yet, in fetch order, so a branch knows where it is. Per
+   branch address the number of executions and taken executions are counted for the profile of the run.
+   A program laid out from a profile (--profile-in) runs with skipBranchShadows set : the fetch stage skips the two
+   slots after a conditional branch and only a taken branch flushes the pipeline, which is the cost model the layout
+   pass optimizes for. Otherwise every branch flushes the instructions fetched after it.
+*/
+
+_Thread_local short fetchedAddresses[pipelineQueueSize * 2];
+_Thread_local int fetchedAddressCount = 0;
+_Thread_local int branchExecutions[INSTRUCTION_MEMORY_SIZE];
+_Thread_local int branchTakenExecutions[INSTRUCTION_MEMORY_SIZE];
+char *profileOutputPath = NULL;
+char *profileInputPath = NULL;
+bool skipBranchShadows = false;
+
+/* Edge coverage of the fuzzing harness, recorded by executeInstruction() while coverageMap is set. */
+
+_Thread_local unsigned char *coverageMap = NULL;
+_Thread_local int previousCoveredAddress;
+_Thread_local int previousCoveredOpcode;
+
+/* Trace output. By default every assembled line, clock cycle and executed instruction is printed. Batch runs
+   (multiple cores, --quiet) switch it off, since interleaved output from several cores is unreadable and the
+   formatting dominates the run time.
+*/
+
+bool traceOutput = true;
+#define TRACE(...)                   \
+    do                               \
+    {                                \
+        if (traceOutput)             \
+        {                            \
+            printf(__VA_ARGS__);     \
+        }                            \
+    } while (0)
+
+/* Reports of the passes and runs (optimizer, scheduler, layout, memo cache, cores, host counters and the expected
+   state check) go to stdout with the trace, unless --output binary keeps stdout for the binary state.
+*/
+
+bool reportToStderr = false;
+#define REPORT(...) fprintf(reportToStderr ? stderr : stdout, __VA_ARGS__)
+
+/* Multicore coordination. Cores run in quanta of coreQuantum clock cycles. In the default mode a pool of
+   min(numOfCores, host processors) workers runs the cores, worker w taking cores w, w + coreWorkers, ..., and the
+   workers meet at a barrier after every round of quanta. In deterministic mode a single worker runs the cores in id
+   order so the interleaving of their accesses to dataMem is the same on every run.
+*/
+
+int numOfCores = 1;
+int coreQuantum = DEFAULT_CORE_QUANTUM;
+bool deterministicCores = false;
+int runningCores;
+int coreWorkers;
+coreContext cores[MAX_CORES];
+pthread_barrier_t coreBarrier;
 
 /* These methods are used for program initalization. They read the text file instruction,
    then transform the assembly instructions into binary strings, which are then transformed into short,
@@ -113,6 +236,91 @@ char *registerBinary[generalPuproseRegister] = {
     "110000", "110001", "110010", "110011", "110100", "110101", "110110", "110111",
     "111000", "111001", "111010", "111011", "111100", "111101", "111110", "111111"};
 
+/* Bit manipulation instructions share opcode 12 (1100). The 6 bit field after the register holds a 3 bit operation
+   followed by a 3 bit operand :
+    0. POPCNT R1      R1 <- number of set bits in R1
+    1. CLZ R1         R1 <- number of leading zero bits in R1 (8 when R1 is 0)
+    2. CTZ R1         R1 <- number of trailing zero bits in R1 (8 when R1 is 0)
+    3. ROL R1, IMM    R1 <- R1 rotated left by IMM (0 - 7)
+    4. ROR R1, IMM    R1 <- R1 rotated right by IMM (0 - 7)
+    5. BFX R1, Rk     R1 <- bit field of R1 described by Rk, moved down to bit 0
+    6. BFI R1, Rk     bit field of R1 described by Rk <- low bits of R(k+1)
+    7. BREV R1        R1 <- R1 with its bit order reversed
+   A bit field descriptor holds the position of the lowest bit of the field in bits 2 - 0 and the width minus one in
+   bits 5 - 3. Rk has to be one of R0 - R7, and one of R0 - R6 for BFI; the assembler rejects any other operand.
+*/
+
+char *bitOperationNames[8] = {"POPCNT", "CLZ", "CTZ", "ROL", "ROR", "BFX", "BFI", "BREV"};
+
+int getBitOperation(char *mnemonic)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        if (strcmp(bitOperationNames[i], mnemonic) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* Vector instructions share opcode 13 (1101) and work on 8 lanes of 8 bits. Vector register Vn is the aligned group of
+   general purpose registers R(8n) - R(8n+7), and memory block b is the 8 bytes of data memory starting at address 8b.
+   The register field holds a 3 bit operation followed by the 3 bit destination vector register, the last field holds
+   the source vector register, a shift amount or a block number (0 - 63) :
+    0. VADD Vd, Vs    Vd <- Vd + Vs, lane by lane
+    1. VSUB Vd, Vs    Vd <- Vd - Vs, lane by lane
+    2. VAND Vd, Vs    Vd <- Vd & Vs
+    3. VXOR Vd, Vs    Vd <- Vd ^ Vs
+    4. VSHL Vd, IMM   Vd <- every lane shifted left by IMM (0 - 7)
+    5. VSHR Vd, IMM   Vd <- every lane shifted right by IMM (0 - 7), filling with zeros
+    6. VLDR Vd, IMM   Vd <- memory block IMM
+    7. VSTR Vd, IMM   memory block IMM <- Vd
+   The assembler rejects vector registers outside V0 - V7 and shifts or blocks outside their ranges. Vector
+   instructions do not change the status register.
+*/
+
+char *vectorOperationNames[8] = {"VADD", "VSUB", "VAND", "VXOR", "VSHL", "VSHR", "VLDR", "VSTR"};
+
+int getVectorOperation(char *mnemonic)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        if (strcmp(vectorOperationNames[i], mnemonic) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* Register indirect memory instructions share opcode 14 (1110). The address is held in a pointer register pair,
+   either R60 (high byte) : R61 (low byte) or R62 : R63, and wraps around the 2048 bytes of data memory. The last field
+   holds a 2 bit operation, 1 bit selecting the pointer pair and a 3 bit offset or register count :
+    0. LDRX R1, R60, OFF     R1 <- MEM[R60:R61 + OFF] (OFF 0 - 7, 0 when omitted)
+    1. STRX R1, R60, OFF     MEM[R60:R61 + OFF] <- R1
+    2. LDM R1, R60, COUNT    R1 ... R(1+COUNT-1) <- MEM[R60:R61] ..., then R60:R61 <- R60:R61 + COUNT (COUNT 1 - 8)
+    3. STM R1, R60, COUNT    MEM[R60:R61] ... <- R1 ... R(1+COUNT-1), then R60:R61 <- R60:R61 + COUNT
+   Load/store multiple advance the pointer pair past the transferred bytes, so a loop can walk a buffer with it.
+*/
+
+char *memoryOperationNames[4] = {"LDRX", "STRX", "LDM", "STM"};
+
+int getMemoryOperation(char *mnemonic)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        if (strcmp(memoryOperationNames[i], mnemonic) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
 char *getOpcodeBinary(char *opcode)
 {
     // Map opipelineCoordinatorode to its binary representation
@@ -164,6 +372,22 @@ char *getOpcodeBinary(char *opcode)
     {
         return "1011";
     }
+    else if (getBitOperation(opcode) >= 0)
+    {
+        return "1100";
+    }
+    else if (getVectorOperation(opcode) >= 0)
+    {
+        return "1101";
+    }
+    else if (getMemoryOperation(opcode) >= 0)
+    {
+        return "1110";
+    }
+    else if (strcmp(opcode, "BNEZ") == 0)
+    {
+        return "1111";
+    }
     // Handle invalid opipelineCoordinatorode
     return NULL;
 }
@@ -217,29 +441,143 @@ char *intToBinary(int num)
     return binary;
 }
 
+// value of an operand made of the prefix (none for an immediate) and up to 8 bits of decimal digits, -1 otherwise.
+int parseOperand(char *token, char prefix)
+{
+    char *end;
+
+    if (token == NULL || (prefix != '\0' && *token++ != prefix) || token[0] < '0' || token[0] > '9')
+    {
+        return -1;
+    }
+    long value = strtol(token, &end, 10);
+    if ((*end != '\0' && *end != '\r' && *end != '\n') || value > 255)
+    {
+        return -1;
+    }
+    return (int)value;
+}
+
 short convertToBinary(char *line)
 {
     // first token is the instruction mnemonic separated by the registers using a space.
     char *token = strtok(line, " ");
     char *opcodeBinary = getOpcodeBinary(token);
+    int bitOperation = getBitOperation(token);
+    int vectorOperation = getVectorOperation(token);
+    int memoryOperation = getMemoryOperation(token);
 
     // move to next token :
-    token = strtok(NULL, ", ");
-    char *srcRegisterBinary = getRegisterBinary(token);
+    token = strtok(NULL, ", \r\n");
+    char *srcRegisterBinary;
+    // vector format, the register field holds the operation followed by the vector register.
+    if (vectorOperation >= 0)
+    {
+        int vectorRegister = parseOperand(token, 'V');
+        if (vectorRegister < 0 || vectorRegister > 7)
+        {
+            printf("%s needs vector registers between V0 and V7.\n", vectorOperationNames[vectorOperation]);
+            exit(1);
+        }
+        srcRegisterBinary = intToBinary((vectorOperation << 3) | vectorRegister);
+    }
+    else
+    {
+        srcRegisterBinary = getRegisterBinary(token);
+    }
 
     // move to last token :
     token = strtok(NULL, ", ");
 
     // last token was being generated with \n character, we remove it and repipelineace it with \0.
-    char *newline = strchr(token, '\n');
+    char *newline = token == NULL ? NULL : strchr(token, '\n');
     if (newline != NULL)
     {
         *newline = '\0'; // Repipelineace '\n' with '\0' to terminate the string
     }
 
     char *dstRegisterBinary;
+    // bit manipulation format, operation followed by an optional register or immediate operand.
+    if (bitOperation >= 0)
+    {
+        int operand = 0;
+        if (bitOperation == 5 || bitOperation == 6)
+        {
+            // BFI also reads R(k+1), so its descriptor register stops at R6.
+            operand = parseOperand(token, 'R');
+            if (operand < 0 || operand > (bitOperation == 6 ? 6 : 7))
+            {
+                printf("%s needs a descriptor register between R0 and R%d.\n", bitOperationNames[bitOperation],
+                       bitOperation == 6 ? 6 : 7);
+                exit(1);
+            }
+        }
+        else if (bitOperation == 3 || bitOperation == 4)
+        {
+            operand = token == NULL ? 0 : parseOperand(token, '\0');
+            if (operand < 0 || operand > 7)
+            {
+                printf("%s needs a rotation between 0 and 7.\n", bitOperationNames[bitOperation]);
+                exit(1);
+            }
+        }
+        dstRegisterBinary = intToBinary((bitOperation << 3) | operand);
+    }
+    // register indirect format, pointer pair followed by an optional offset or register count.
+    else if (memoryOperation >= 0)
+    {
+        int pointerRegister = parseOperand(token, 'R');
+        if (pointerRegister != FIRST_POINTER_REGISTER && pointerRegister != FIRST_POINTER_REGISTER + 2)
+        {
+            printf("%s needs R%d or R%d as its pointer register.\n", memoryOperationNames[memoryOperation],
+                   FIRST_POINTER_REGISTER, FIRST_POINTER_REGISTER + 2);
+            exit(1);
+        }
+
+        token = strtok(NULL, ", \r\n");
+        int amount = token == NULL ? 0 : atoi(token);
+        if (memoryOperation >= 2)
+        {
+            // the field holds the register count minus one.
+            if (token != NULL && (amount < 1 || amount > 8))
+            {
+                printf("%s needs a register count between 1 and 8.\n", memoryOperationNames[memoryOperation]);
+                exit(1);
+            }
+            amount = token == NULL ? 0 : amount - 1;
+        }
+        else if (amount < 0 || amount > 7)
+        {
+            printf("%s needs an offset between 0 and 7.\n", memoryOperationNames[memoryOperation]);
+            exit(1);
+        }
+
+        int pointerPair = (pointerRegister - FIRST_POINTER_REGISTER) / 2;
+        dstRegisterBinary = intToBinary((memoryOperation << 4) | (pointerPair << 3) | (amount & 0b111));
+    }
+    // vector format, source vector register, shift amount or memory block.
+    else if (vectorOperation >= 0)
+    {
+        int operand = parseOperand(token, vectorOperation < 4 ? 'V' : '\0');
+        if (vectorOperation < 4 && (operand < 0 || operand > 7))
+        {
+            printf("%s needs vector registers between V0 and V7.\n", vectorOperationNames[vectorOperation]);
+            exit(1);
+        }
+        else if (vectorOperation < 6 && (operand < 0 || operand > 7))
+        {
+            printf("%s needs a shift between 0 and 7.\n", vectorOperationNames[vectorOperation]);
+            exit(1);
+        }
+        else if (operand < 0 || operand > 63)
+        {
+            printf("%s needs a memory block between 0 and 63.\n", vectorOperationNames[vectorOperation]);
+            exit(1);
+        }
+        dstRegisterBinary = intToBinary(operand);
+    }
     // register format
-    if (token[0] == 'R')
+    else if (token[0] == 'R')
     {
         dstRegisterBinary = getRegisterBinary(token);
         // immediate format
@@ -270,7 +608,7 @@ short convertToBinary(char *line)
         strcat(instructionInBinary, dstRegisterBinary);
     }
 
-    printf("%s\n", instructionInBinary);
+    TRACE("%s\n", instructionInBinary);
 
     // transform into short
     short result = 0;
@@ -283,20 +621,34 @@ short convertToBinary(char *line)
     return result;
 }
 
-void loadProgram(char *filePath)
+/* Optional assembler passes run over the assembled program before it is placed in the instruction memory. They are
+   defined after the data path functions, since they decode the instructions they rewrite.
+*/
+
+bool optimizeAssembly = false;
+char *schedulePipeline = NULL;
+void optimizeProgram(short *program, int *programLength);
+void scheduleProgram(short *program, int programLength, char *pipelineName);
+void layoutProgram(short *program, int *programLength, char *profilePath);
+
+/* resetCore() resets the state private to the running core (instruction memory, register file and pipeline).
+   loadCoreProgram() resets the core and assembles the program into its instruction memory. The shared data memory
+   is left untouched so that cores can be loaded while others already hold their data in dataMem.
+   Every word past numOfInstruction is kept 0, so only the words of the previous program are cleared. Fetching stops
+   at the first 0 word, so the branch counters of the previous program lie below numOfInstruction as well.
+*/
+void resetCore()
 {
-    // initialize all instMemory to 0, all dataMem to 0, all regFile to 0.
+    // initialize the instMemory of the previous program to 0, all regFile to 0.
     int j;
 
-    for (j = 0; j < DATA_MEMORY_SIZE; j++)
-    {
-        dataMem.dataMemory[j] = 0;
-    }
-
-    for (j = 0; j < INSTRUCTION_MEMORY_SIZE; j++)
+    for (j = 0; j < numOfInstruction; j++)
     {
         instMemory.instructionMemory[j] = 0;
+        branchExecutions[j] = 0;
+        branchTakenExecutions[j] = 0;
     }
+    numOfInstruction = 0;
 
     for (j = 0; j < generalPuproseRegister; j++)
     {
@@ -306,29 +658,78 @@ void loadProgram(char *filePath)
     regFile.PCRegister = 0;
     regFile.statusRegister = 0;
 
+    clockCycle = 1;
+    pipelineControl = 1;
+    instructionsExecuted = 0;
+    instructionsStage = (pipelineStages){0, 0, 0, false, false};
+    fetchedAddressCount = 0;
+}
+
+void loadCoreProgram(char *filePath)
+{
+    int j;
+
+    resetCore();
+
     // opened the file containing the instructions.
     FILE *file = fopen(filePath, "r");
 
     if (file == NULL)
     {
         perror("File cannot be opened.");
+        exit(1);
     }
 
     // maximum length of a line in a text file is 256 characters
     char line[256];
+    short program[INSTRUCTION_MEMORY_SIZE];
 
     int i = 0;
     while (fgets(line, 256, file) != NULL)
     {
-        printf("Line %d : %s\n", i, line);
-        instMemory.instructionMemory[i] = convertToBinary(line);
-        printf("Instruction Memory [%d] = %d\n\n", i, instMemory.instructionMemory[i]);
+        TRACE("Line %d : %s\n", i, line);
+        program[i] = convertToBinary(line);
+        TRACE("Instruction Memory [%d] = %d\n\n", i, program[i]);
         i++;
     }
 
+    fclose(file);
+
+    if (optimizeAssembly)
+    {
+        optimizeProgram(program, &i);
+    }
+
+    if (schedulePipeline != NULL)
+    {
+        scheduleProgram(program, i, schedulePipeline);
+    }
+
+    if (profileInputPath != NULL)
+    {
+        layoutProgram(program, &i, profileInputPath);
+    }
+
+    for (j = 0; j < i; j++)
+    {
+        instMemory.instructionMemory[j] = program[j];
+    }
+
     numOfInstruction = i;
+}
 
-    fclose(file);
+void loadProgram(char *filePath)
+{
+    // initialize all dataMem to 0, then load the program into the current core.
+    int j;
+
+    for (j = 0; j < DATA_MEMORY_SIZE; j++)
+    {
+        coreDataMem->dataMemory[j] = 0;
+    }
+    memset(coreDataMem->dirty, 0, sizeof(coreDataMem->dirty));
+
+    loadCoreProgram(filePath);
 }
 
 /* Queue Methods. These are used for the coordination of the pipeline block.*/
@@ -461,6 +862,7 @@ void flushPipeline(toBeDecodedQueue *dq, toBeExecutedQueue *eq, char immediateVa
     instructionsStage.decoded = 0;
     instructionsStage.executed = 0;
     instructionsStage.controlHazardFlag = true;
+    fetchedAddressCount = 0;
 
     while (toBeDecodedIsEmpty(dq) == false || toBeExecutedIsEmpty(eq) == false)
     {
@@ -479,9 +881,9 @@ void flushPipeline(toBeDecodedQueue *dq, toBeExecutedQueue *eq, char immediateVa
 /* Method updateStatusRegister, to modify status registers on certain operations as described
     1. The Carry flag (C) is updated every ADD instruction.
     2. The Overflow flag (V) is updated every ADD and SUB instruction.
-    3. The Negative flag (N) is updated every ADD, SUB, MUL, ANDI, EOR, SAL, and SAR instruction.
+    3. The Negative flag (N) is updated every ADD, SUB, MUL, ANDI, EOR, SAL, SAR and bit manipulation instruction.
     4. The Sign flag (S) is updated every ADD and SUB instruction.
-    5. The Zero flag (Z) is updated every ADD, SUB, MUL, ANDI, EOR, SAL, and SAR instruction.
+    5. The Zero flag (Z) is updated every ADD, SUB, MUL, ANDI, EOR, SAL, SAR and bit manipulation instruction.
     6. A flag value can only be updated by the instructions related to it.
 */
 
@@ -548,14 +950,17 @@ void updateStatusRegister(char firstOp, char secondOp, char newVal, decodedInstr
     }
 
     // Print the status register
-    printf("Status Register : ");
-    // Start from the most significant bit (bit 7)
-    for (int i = 7; i >= 0; i--)
+    if (traceOutput)
     {
-        char bit = (regFile.statusRegister >> i) & 1;
-        printf("%d", bit);
+        printf("Status Register : ");
+        // Start from the most significant bit (bit 7)
+        for (int i = 7; i >= 0; i--)
+        {
+            char bit = (regFile.statusRegister >> i) & 1;
+            printf("%d", bit);
+        }
+        printf("\n");
     }
-    printf("\n");
 }
 
 /* Data Path Functions. Fetch(), Decode() & Execute(), each with their respective parameters for
@@ -564,10 +969,34 @@ pipeline coordination.*/
 short fetchInstruction()
 {
     short currInstructionFetched = instMemory.instructionMemory[regFile.PCRegister];
+    int fetchedOpcode = (currInstructionFetched >> 12) & 0b1111;
+
+    if (fetchedAddressCount < pipelineQueueSize * 2)
+    {
+        fetchedAddresses[fetchedAddressCount++] = regFile.PCRegister;
+    }
     regFile.PCRegister++;
+
+    // a conditional branch that is not taken continues BRANCH_FALL_THROUGH instructions after it, so for a laid out
+    // program fetching skips the two slots in its shadow and goes on along the not taken path.
+    if (skipBranchShadows && (fetchedOpcode == 4 || fetchedOpcode == 15))
+    {
+        regFile.PCRegister += BRANCH_FALL_THROUGH - 1;
+    }
     return currInstructionFetched;
 }
 
+short popFetchedAddress()
+{
+    short address = fetchedAddresses[0];
+    for (int i = 1; i < fetchedAddressCount; i++)
+    {
+        fetchedAddresses[i - 1] = fetchedAddresses[i];
+    }
+    fetchedAddressCount = fetchedAddressCount > 0 ? fetchedAddressCount - 1 : 0;
+    return address;
+}
+
 decodedInstruction decodeInstruction(short currInstructionDecoded)
 {
     decodedInstruction decodedInst;
@@ -584,7 +1013,8 @@ decodedInstruction decodeInstruction(short currInstructionDecoded)
 
     // we have to sign extend the immediate value.
 
-    if ((decodedInst.opcode == 4 || decodedInst.opcode == 10 || decodedInst.opcode == 11))
+    if ((decodedInst.opcode == 4 || decodedInst.opcode == 10 || decodedInst.opcode == 11 || decodedInst.opcode == 12 ||
+         decodedInst.opcode == 13 || decodedInst.opcode == 14 || decodedInst.opcode == 15))
     {
         decodedInst.immediateVal = decodedInst.immediateVal & 0b00111111;
     }
@@ -604,126 +1034,568 @@ decodedInstruction decodeInstruction(short currInstructionDecoded)
     return decodedInst;
 }
 
-void executeInstruction(decodedInstruction decodedInst)
+/* Loads and stores of the data memory. In a parallel multicore run several host threads access dataMem at the same
+    time, so every byte is read and written with a relaxed atomic access. This keeps the race between simulated
+    cores defined (each access sees some value stored by a core) without ordering them, just as the cores of the
+    simulated machine have no ordering between each other either.
+*/
+char loadDataByte(int address)
 {
-    // currInstructionExecuted = currInstructionDecoded;
-    char srcRegVal, dstRegVal, memoryWord;
-    char newVal;
-    switch (decodedInst.opcode)
+    return __atomic_load_n(&coreDataMem->dataMemory[address], __ATOMIC_RELAXED);
+}
+
+void storeDataByte(int address, char value)
+{
+    __atomic_store_n(&coreDataMem->dataMemory[address], value, __ATOMIC_RELAXED);
+}
+
+/* Marks bytes of the data memory as written. Cores of a multicore run share the bitmap, so the bits are set
+    atomically.
+*/
+void markDirty(int address, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
     {
+        int byteAddress = (address + i) % DATA_MEMORY_SIZE;
+        __atomic_fetch_or(&coreDataMem->dirty[byteAddress / 64], 1ULL << (byteAddress % 64), __ATOMIC_RELAXED);
+    }
+}
 
-    // Add opcode, register type instruction. Add : srcRegister <- srcRegister + dstRegister
+/* Executes one instruction of the bit manipulation group (opcode 12), using the host bit counting builtins. The
+    operands are treated as unsigned 8 bit values.
+*/
+void executeBitOperation(decodedInstruction decodedInst)
+{
+    unsigned char srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
+    int operation = (decodedInst.immediateVal >> 3) & 0b111;
+    int operand = decodedInst.immediateVal & 0b111;
+    unsigned char descriptor = regFile.generalRegisterFile[operand];
+    int position = descriptor & 0b111;
+    int width = ((descriptor >> 3) & 0b111) + 1;
+    unsigned char fieldMask = ((1 << width) - 1) << position;
+    unsigned char newVal;
+
+    switch (operation)
+    {
     case 0:
-        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
-        dstRegVal = regFile.generalRegisterFile[decodedInst.dstRegister];
-        newVal = srcRegVal + dstRegVal;
-        regFile.generalRegisterFile[decodedInst.srcRegister] = newVal;
-        updateStatusRegister(srcRegVal, dstRegVal, newVal, decodedInst);
-        printf("ADD : R%d Value : %d, R%d Value : %d, Value in Register %d After Execution %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.dstRegister, dstRegVal, decodedInst.srcRegister, newVal);
+        newVal = __builtin_popcount(srcRegVal);
         break;
-
-    // Sub opcode, register type instruction. Sub : srcRegister <- srcRegister - dstRegister
     case 1:
-        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
-        dstRegVal = regFile.generalRegisterFile[decodedInst.dstRegister];
-        newVal = srcRegVal - dstRegVal;
-        regFile.generalRegisterFile[decodedInst.srcRegister] = newVal;
-        updateStatusRegister(srcRegVal, dstRegVal, newVal, decodedInst);
-        printf("SUB : R%d Value : %d, R%d Value : %d, Value in Register %d After Execution %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.dstRegister, dstRegVal, decodedInst.srcRegister, newVal);
+        newVal = srcRegVal == 0 ? 8 : __builtin_clz(srcRegVal) - (int)(8 * sizeof(unsigned int) - 8);
         break;
-
-    // Mul opcode, register type instruction. Mul : srcRegister <- srcRegister * dstRegister
     case 2:
-        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
-        dstRegVal = regFile.generalRegisterFile[decodedInst.dstRegister];
-        newVal = srcRegVal * dstRegVal;
-        regFile.generalRegisterFile[decodedInst.srcRegister] = newVal;
-        updateStatusRegister(srcRegVal, dstRegVal, newVal, decodedInst);
-        printf("MUL : R%d Value : %d, R%d Value : %d, Value in Register %d After Execution %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.dstRegister, dstRegVal, decodedInst.srcRegister, newVal);
+        newVal = srcRegVal == 0 ? 8 : __builtin_ctz(srcRegVal);
         break;
-
-    // Movi opcode, immediate type instruction. MOVI : srcRegister <- Immediate
     case 3:
-        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
-        regFile.generalRegisterFile[decodedInst.srcRegister] = decodedInst.immediateVal;
-        printf("MOVI : R%d old Value : %d, Value in R%d after MOVI : %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.srcRegister, decodedInst.immediateVal);
+        newVal = (srcRegVal << operand) | (srcRegVal >> ((8 - operand) & 0b111));
         break;
-
-    // BEQZ opcode, if (R1 == 0) {PC = PC +1 + Immediate}
     case 4:
-        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
-        short oldPCVal = regFile.PCRegister;
-        if (srcRegVal == 0)
-        {
-            regFile.PCRegister += decodedInst.immediateVal;
-        }
-        printf("BEQZ : R%d Value : %d, Old PC Value : %d, Immediate Value : %d ,New PC Value After BEQZ : %d\n", decodedInst.srcRegister, srcRegVal, oldPCVal, decodedInst.immediateVal, regFile.PCRegister);
-        flushPipeline(&toBeDecodedq, &toBeExecutedq, decodedInst.immediateVal);
+        newVal = (srcRegVal >> operand) | (srcRegVal << ((8 - operand) & 0b111));
         break;
-
-    // ANDI opcode. R1 <- R1 & IMM.
     case 5:
-        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
-        newVal = srcRegVal & decodedInst.immediateVal;
-        regFile.generalRegisterFile[decodedInst.srcRegister] = newVal;
-        updateStatusRegister(srcRegVal, '0', newVal, decodedInst);
-        printf("ANDI : R%d Value : %d, Immediate Value : %d, Value in Register %d After ANDI %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.immediateVal, decodedInst.srcRegister, newVal);
+        newVal = (srcRegVal & fieldMask) >> position;
         break;
-
-    // EOR Opcode. R1 <- R1 XOR R2
     case 6:
-        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
-        dstRegVal = regFile.generalRegisterFile[decodedInst.dstRegister];
-        newVal = srcRegVal ^ dstRegVal;
-        regFile.generalRegisterFile[decodedInst.srcRegister] = newVal;
-        updateStatusRegister(srcRegVal, dstRegVal, newVal, decodedInst);
-        printf("EOR : R%d Value : %d, R%d Value : %d, Value in Register %d After EOR %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.dstRegister, dstRegVal, decodedInst.srcRegister, newVal);
+        newVal = (srcRegVal & ~fieldMask) | (((unsigned char)regFile.generalRegisterFile[operand + 1] << position) & fieldMask);
         break;
-
-    // BR Opcode. PC = R1 concat. R2
-    case 7:
-        char newAddr[3];
-        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
-        dstRegVal = regFile.generalRegisterFile[decodedInst.dstRegister];
-        newAddr[0] = srcRegVal;
-        newAddr[1] = dstRegVal;
-        newAddr[2] = '\0';
-        short newAddress = (srcRegVal << 8) | dstRegVal;
-        regFile.PCRegister = newAddress;
-        printf("BR : R%d Value : %d, R%d Value : %d, Value in PC After BR %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.dstRegister, dstRegVal, regFile.PCRegister);
-        flushPipeline(&toBeDecodedq, &toBeExecutedq, (char)atoi(newAddr));
+    default:
+        // reverse the bits by spreading the byte over a 64 bit word and folding it back.
+        newVal = ((srcRegVal * 0x0202020202ULL) & 0x010884422010ULL) % 1023;
         break;
+    }
 
-    // SAL opcode. R1 = R1 << IMM.
-    case 8:
-        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
-        newVal = srcRegVal << decodedInst.immediateVal;
-        regFile.generalRegisterFile[decodedInst.srcRegister] = newVal;
-        updateStatusRegister(srcRegVal, '0', newVal, decodedInst);
-        printf("SAL : R%d Value : %d, R%d Value after being shifted to the left %d times : %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.srcRegister, decodedInst.immediateVal, newVal);
-        break;
+    regFile.generalRegisterFile[decodedInst.srcRegister] = newVal;
+    updateStatusRegister(srcRegVal, '0', newVal, decodedInst);
+    TRACE("%s : R%d Value : %d, Operand : %d, Value in Register %d After %s %d\n", bitOperationNames[operation],
+          decodedInst.srcRegister, (char)srcRegVal, operand, decodedInst.srcRegister, bitOperationNames[operation],
+          (char)newVal);
+}
 
-    // SAR opcode.
-    case 9:
-        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
-        newVal = srcRegVal >> decodedInst.immediateVal;
-        regFile.generalRegisterFile[decodedInst.srcRegister] = newVal;
-        updateStatusRegister(srcRegVal, '0', newVal, decodedInst);
-        printf("SAR : R%d Value : %d, R%d Value after being shifted to the right %d times : %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.srcRegister, decodedInst.immediateVal, newVal);
-        break;
+/* Executes one instruction of the vector group (opcode 13). The 8 lanes are packed into a 64 bit word and processed
+    together (SWAR), masking the bits that would otherwise carry or shift into the neighbouring lane.
+*/
+void executeVectorOperation(decodedInstruction decodedInst)
+{
+    const uint64_t lowBits = 0x0101010101010101ULL;
+    const uint64_t highBits = 0x8080808080808080ULL;
+    int operation = (decodedInst.srcRegister >> 3) & 0b111;
+    char *dstVector = &regFile.generalRegisterFile[(decodedInst.srcRegister & 0b111) * VECTOR_LANES];
+    char *srcVector = &regFile.generalRegisterFile[(decodedInst.immediateVal & 0b111) * VECTOR_LANES];
+    int memoryBlock = decodedInst.immediateVal * VECTOR_LANES;
+    int shift = decodedInst.immediateVal & 0b111;
+    uint64_t dstLanes, srcLanes;
 
-    // Load word from memory.
-    case 10:
-        memoryWord = dataMem.dataMemory[decodedInst.immediateVal];
+    memcpy(&dstLanes, dstVector, VECTOR_LANES);
+    memcpy(&srcLanes, srcVector, VECTOR_LANES);
+
+    switch (operation)
+    {
+    case 0:
+        dstLanes = ((dstLanes & ~highBits) + (srcLanes & ~highBits)) ^ ((dstLanes ^ srcLanes) & highBits);
+        break;
+    case 1:
+        dstLanes = ((dstLanes | highBits) - (srcLanes & ~highBits)) ^ ((dstLanes ^ ~srcLanes) & highBits);
+        break;
+    case 2:
+        dstLanes &= srcLanes;
+        break;
+    case 3:
+        dstLanes ^= srcLanes;
+        break;
+    case 4:
+        dstLanes = (dstLanes << shift) & (lowBits * ((0xFF << shift) & 0xFF));
+        break;
+    case 5:
+        dstLanes = (dstLanes >> shift) & (lowBits * (0xFF >> shift));
+        break;
+    case 6:
+        for (int i = 0; i < VECTOR_LANES; i++)
+        {
+            dstVector[i] = loadDataByte(memoryBlock + i);
+        }
+        memcpy(&dstLanes, dstVector, VECTOR_LANES);
+        break;
+    default:
+        for (int i = 0; i < VECTOR_LANES; i++)
+        {
+            storeDataByte(memoryBlock + i, dstVector[i]);
+        }
+        markDirty(memoryBlock, VECTOR_LANES);
+        TRACE("VSTR : V%d was stored into memory block %d (address %d)\n", decodedInst.srcRegister & 0b111,
+              decodedInst.immediateVal, decodedInst.immediateVal * VECTOR_LANES);
+        return;
+    }
+
+    memcpy(dstVector, &dstLanes, VECTOR_LANES);
+    TRACE("%s : V%d, Operand : %d, Lanes in V%d After %s :", vectorOperationNames[operation],
+          decodedInst.srcRegister & 0b111, decodedInst.immediateVal, decodedInst.srcRegister & 0b111,
+          vectorOperationNames[operation]);
+    for (int i = 0; i < VECTOR_LANES; i++)
+    {
+        TRACE(" %d", dstVector[i]);
+    }
+    TRACE("\n");
+}
+
+/* Executes one instruction of the register indirect group (opcode 14). */
+void executeMemoryOperation(decodedInstruction decodedInst)
+{
+    int operation = (decodedInst.immediateVal >> 4) & 0b11;
+    int pointerRegister = FIRST_POINTER_REGISTER + ((decodedInst.immediateVal >> 3) & 0b1) * 2;
+    int amount = decodedInst.immediateVal & 0b111;
+    unsigned char highByte = regFile.generalRegisterFile[pointerRegister];
+    unsigned char lowByte = regFile.generalRegisterFile[pointerRegister + 1];
+    int address = ((highByte << 8) | lowByte) % DATA_MEMORY_SIZE;
+    int i;
+
+    switch (operation)
+    {
+    case 0:
+        address = (address + amount) % DATA_MEMORY_SIZE;
+        regFile.generalRegisterFile[decodedInst.srcRegister] = loadDataByte(address);
+        TRACE("LDRX : Word in Memory Address %d : %d, was loaded into Register %d\n", address,
+              regFile.generalRegisterFile[decodedInst.srcRegister], decodedInst.srcRegister);
+        return;
+    case 1:
+        address = (address + amount) % DATA_MEMORY_SIZE;
+        storeDataByte(address, regFile.generalRegisterFile[decodedInst.srcRegister]);
+        markDirty(address, 1);
+        TRACE("STRX : Word in Register %d : %d , was stored into memory at address %d\n", decodedInst.srcRegister,
+              regFile.generalRegisterFile[decodedInst.srcRegister], address);
+        return;
+    case 2:
+        for (i = 0; i <= amount; i++)
+        {
+            regFile.generalRegisterFile[(decodedInst.srcRegister + i) % generalPuproseRegister] =
+                loadDataByte((address + i) % DATA_MEMORY_SIZE);
+        }
+        break;
+    default:
+        for (i = 0; i <= amount; i++)
+        {
+            storeDataByte((address + i) % DATA_MEMORY_SIZE,
+                          regFile.generalRegisterFile[(decodedInst.srcRegister + i) % generalPuproseRegister]);
+        }
+        markDirty(address, amount + 1);
+        break;
+    }
+
+    // load/store multiple write the advanced pointer back to the pair.
+    int newAddress = ((highByte << 8) | lowByte) + amount + 1;
+    regFile.generalRegisterFile[pointerRegister] = (newAddress >> 8) & 0xFF;
+    regFile.generalRegisterFile[pointerRegister + 1] = newAddress & 0xFF;
+    TRACE("%s : %d Registers starting at R%d, Memory Address %d, Value in R%d:R%d After %s %d\n",
+          memoryOperationNames[operation], amount + 1, decodedInst.srcRegister, address, pointerRegister,
+          pointerRegister + 1, memoryOperationNames[operation], newAddress & 0xFFFF);
+}
+
+/* Host hardware counters. With --counters a single core run is measured with perf_event_open() in four phases:
+    assembly (loadProgram()), the pipeline (moveThroughPipeline() without the instructions it executes), execution
+    (executeInstruction(), also split by simulated opcode) and output of the final state. The counters are read
+    around every executed instruction, which slows the run down, and the cost of those reads lands in the pipeline
+    phase. A counter the host does not provide is reported as n/a; without perf_event_open() (other systems,
+    containers, perf_event_paranoid) only the wall-clock time of every phase is reported.
+*/
+
+#define HOST_COUNTERS 4
+#define HOST_PHASES 4
+#define PHASE_ASSEMBLY 0
+#define PHASE_PIPELINE 1
+#define PHASE_EXECUTE 2
+#define PHASE_OUTPUT 3
+
+char *hostCounterNames[HOST_COUNTERS] = {"cycles", "instructions", "branch_misses", "cache_misses"};
+char *hostPhaseNames[HOST_PHASES] = {"assembly", "pipeline", "execute", "output"};
+char *opcodeNames[16] = {"ADD", "SUB", "MUL", "MOVI", "BEQZ", "ANDI", "EOR", "BR",
+                         "SAL", "SAR", "LDR", "STR", "BIT", "VECTOR", "MEMORY", "BNEZ"};
+
+bool hostCountersEnabled = false;
+int hostCounterLeader = -1;
+int hostCounterSlot[HOST_COUNTERS]; // position of the counter in the group read, -1 when the host lacks it
+int hostCountersOpened = 0;
+bool countingInstruction = false;
+struct timespec hostPhaseStart;
+uint64_t hostPhaseStartCounts[HOST_COUNTERS];
+double phaseSeconds[HOST_PHASES];
+uint64_t phaseCounts[HOST_PHASES][HOST_COUNTERS];
+long long opcodeExecutions[16];
+uint64_t opcodeCounts[16][HOST_COUNTERS];
+
+void executeInstruction(decodedInstruction decodedInst);
+double elapsedSeconds(struct timespec start);
+
+void openHostCounters()
+{
+    char *reason = "perf_event_open() is only available on Linux";
+    for (int i = 0; i < HOST_COUNTERS; i++)
+    {
+        hostCounterSlot[i] = -1;
+    }
+#ifdef __linux__
+    uint64_t configs[HOST_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                       PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+    for (int i = 0; i < HOST_COUNTERS; i++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.disabled = hostCounterLeader < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        // the counters form one group led by the first that opens, so a single read() returns all of them.
+        int fd = syscall(SYS_perf_event_open, &attr, 0, -1, hostCounterLeader, 0);
+        if (fd < 0)
+        {
+            reason = strerror(errno);
+            continue;
+        }
+        if (hostCounterLeader < 0)
+        {
+            hostCounterLeader = fd;
+        }
+        hostCounterSlot[i] = hostCountersOpened++;
+    }
+    if (hostCounterLeader >= 0)
+    {
+        ioctl(hostCounterLeader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(hostCounterLeader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+    if (hostCounterLeader < 0)
+    {
+        REPORT("Host counters : unavailable (%s), only the time of every phase is measured\n", reason);
+    }
+}
+
+void readHostCounters(uint64_t *counts)
+{
+    uint64_t group[1 + HOST_COUNTERS];
+    memset(counts, 0, HOST_COUNTERS * sizeof(uint64_t));
+#ifndef _WIN32
+    if (hostCounterLeader < 0 || read(hostCounterLeader, group, sizeof(group)) <= 0)
+    {
+        return;
+    }
+    for (int i = 0; i < HOST_COUNTERS; i++)
+    {
+        if (hostCounterSlot[i] >= 0)
+        {
+            counts[i] = group[1 + hostCounterSlot[i]];
+        }
+    }
+#endif
+}
+
+void beginHostPhase()
+{
+    if (hostCountersEnabled == false)
+    {
+        return;
+    }
+    readHostCounters(hostPhaseStartCounts);
+    clock_gettime(CLOCK_MONOTONIC, &hostPhaseStart);
+}
+
+void endHostPhase(int phase)
+{
+    if (hostCountersEnabled == false)
+    {
+        return;
+    }
+    uint64_t counts[HOST_COUNTERS];
+    phaseSeconds[phase] += elapsedSeconds(hostPhaseStart);
+    readHostCounters(counts);
+    for (int i = 0; i < HOST_COUNTERS; i++)
+    {
+        phaseCounts[phase][i] += counts[i] - hostPhaseStartCounts[i];
+    }
+}
+
+// executeInstruction() hands every instruction to countInstruction(), which executes it between two counter reads.
+void countInstruction(decodedInstruction decodedInst)
+{
+    uint64_t before[HOST_COUNTERS], after[HOST_COUNTERS];
+    struct timespec start;
+    int opcode = decodedInst.opcode & 0b1111;
+    readHostCounters(before);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    countingInstruction = true;
+    executeInstruction(decodedInst);
+    countingInstruction = false;
+    phaseSeconds[PHASE_EXECUTE] += elapsedSeconds(start);
+    readHostCounters(after);
+    opcodeExecutions[opcode]++;
+    for (int i = 0; i < HOST_COUNTERS; i++)
+    {
+        opcodeCounts[opcode][i] += after[i] - before[i];
+        phaseCounts[PHASE_EXECUTE][i] += after[i] - before[i];
+    }
+}
+
+void printHostCounts(uint64_t *counts)
+{
+    for (int i = 0; i < HOST_COUNTERS; i++)
+    {
+        if (hostCounterSlot[i] < 0)
+        {
+            REPORT(" %s=n/a", hostCounterNames[i]);
+        }
+        else
+        {
+            REPORT(" %s=%llu", hostCounterNames[i], (unsigned long long)counts[i]);
+        }
+    }
+    REPORT("\n");
+}
+
+void printHostCounters()
+{
+    // the pipeline phase was measured with the instructions it executed, which belong to the execute phase.
+    phaseSeconds[PHASE_PIPELINE] -= phaseSeconds[PHASE_EXECUTE];
+    for (int i = 0; i < HOST_COUNTERS; i++)
+    {
+        uint64_t executed = phaseCounts[PHASE_EXECUTE][i];
+        phaseCounts[PHASE_PIPELINE][i] = phaseCounts[PHASE_PIPELINE][i] > executed ? phaseCounts[PHASE_PIPELINE][i] - executed : 0;
+    }
+
+    REPORT("\nHost counters -----------------------------------------\n");
+    for (int phase = 0; phase < HOST_PHASES; phase++)
+    {
+        REPORT("phase=%s seconds=%.6f", hostPhaseNames[phase], phaseSeconds[phase] > 0 ? phaseSeconds[phase] : 0.0);
+        printHostCounts(phaseCounts[phase]);
+    }
+    for (int opcode = 0; opcode < 16; opcode++)
+    {
+        if (opcodeExecutions[opcode] > 0)
+        {
+            REPORT("opcode=%s executions=%lld", opcodeNames[opcode], opcodeExecutions[opcode]);
+            printHostCounts(opcodeCounts[opcode]);
+        }
+    }
+}
+
+/* Shift counts come from the signed 6 bit immediate. The count is taken modulo 32, as the host shift did, and a count
+    of 8 or more shifts every bit out of the register.
+*/
+char shiftLeft(char value, int count)
+{
+    count &= 0b11111;
+    return (char)((unsigned char)value << (count > DATA_SIZE ? DATA_SIZE : count));
+}
+
+char shiftRight(char value, int count)
+{
+    count &= 0b11111;
+    return (char)(value >> (count > DATA_SIZE - 1 ? DATA_SIZE - 1 : count));
+}
+
+void executeInstruction(decodedInstruction decodedInst)
+{
+    // currInstructionExecuted = currInstructionDecoded;
+    char srcRegVal, dstRegVal, memoryWord;
+    char newVal;
+    if (hostCountersEnabled && countingInstruction == false)
+    {
+        countInstruction(decodedInst);
+        return;
+    }
+    short instructionAddress = popFetchedAddress();
+    instructionsExecuted++;
+    if (coverageMap != NULL)
+    {
+        // the edge from the previously executed address, and the pair of opcodes executed one after the other.
+        coverageMap[((previousCoveredAddress << 5) ^ instructionAddress) % (FUZZ_MAP_SIZE / 2)] = 1;
+        coverageMap[FUZZ_MAP_SIZE / 2 + ((previousCoveredOpcode << 4) | decodedInst.opcode)] = 1;
+        previousCoveredAddress = instructionAddress;
+        previousCoveredOpcode = decodedInst.opcode;
+    }
+    switch (decodedInst.opcode)
+    {
+
+    // Add opcode, register type instruction. Add : srcRegister <- srcRegister + dstRegister
+    case 0:
+        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
+        dstRegVal = regFile.generalRegisterFile[decodedInst.dstRegister];
+        newVal = srcRegVal + dstRegVal;
+        regFile.generalRegisterFile[decodedInst.srcRegister] = newVal;
+        updateStatusRegister(srcRegVal, dstRegVal, newVal, decodedInst);
+        TRACE("ADD : R%d Value : %d, R%d Value : %d, Value in Register %d After Execution %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.dstRegister, dstRegVal, decodedInst.srcRegister, newVal);
+        break;
+
+    // Sub opcode, register type instruction. Sub : srcRegister <- srcRegister - dstRegister
+    case 1:
+        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
+        dstRegVal = regFile.generalRegisterFile[decodedInst.dstRegister];
+        newVal = srcRegVal - dstRegVal;
+        regFile.generalRegisterFile[decodedInst.srcRegister] = newVal;
+        updateStatusRegister(srcRegVal, dstRegVal, newVal, decodedInst);
+        TRACE("SUB : R%d Value : %d, R%d Value : %d, Value in Register %d After Execution %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.dstRegister, dstRegVal, decodedInst.srcRegister, newVal);
+        break;
+
+    // Mul opcode, register type instruction. Mul : srcRegister <- srcRegister * dstRegister
+    case 2:
+        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
+        dstRegVal = regFile.generalRegisterFile[decodedInst.dstRegister];
+        newVal = srcRegVal * dstRegVal;
+        regFile.generalRegisterFile[decodedInst.srcRegister] = newVal;
+        updateStatusRegister(srcRegVal, dstRegVal, newVal, decodedInst);
+        TRACE("MUL : R%d Value : %d, R%d Value : %d, Value in Register %d After Execution %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.dstRegister, dstRegVal, decodedInst.srcRegister, newVal);
+        break;
+
+    // Movi opcode, immediate type instruction. MOVI : srcRegister <- Immediate
+    case 3:
+        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
+        regFile.generalRegisterFile[decodedInst.srcRegister] = decodedInst.immediateVal;
+        TRACE("MOVI : R%d old Value : %d, Value in R%d after MOVI : %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.srcRegister, decodedInst.immediateVal);
+        break;
+
+    // BEQZ opcode, if (R1 == 0) {PC = PC +1 + Immediate}, BNEZ opcode, if (R1 != 0) {PC = PC +1 + Immediate}.
+    // The fall through address is computed from the address of the branch, BRANCH_FALL_THROUGH instructions after it,
+    // since the PC depends on how far fetching got since the last flush.
+    case 4:
+    case 15:
+        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
+        short oldPCVal = instructionAddress + BRANCH_FALL_THROUGH;
+        bool taken = decodedInst.opcode == 4 ? srcRegVal == 0 : srcRegVal != 0;
+        branchExecutions[instructionAddress % INSTRUCTION_MEMORY_SIZE]++;
+        if (taken)
+        {
+            branchTakenExecutions[instructionAddress % INSTRUCTION_MEMORY_SIZE]++;
+            regFile.PCRegister = oldPCVal + decodedInst.immediateVal;
+        }
+        else if (skipBranchShadows == false)
+        {
+            regFile.PCRegister = oldPCVal;
+        }
+        TRACE("%s : R%d Value : %d, Old PC Value : %d, Immediate Value : %d ,New PC Value After %s : %d\n", decodedInst.opcode == 4 ? "BEQZ" : "BNEZ", decodedInst.srcRegister, srcRegVal, oldPCVal, decodedInst.immediateVal, decodedInst.opcode == 4 ? "BEQZ" : "BNEZ", taken ? regFile.PCRegister : oldPCVal);
+        if (taken || skipBranchShadows == false)
+        {
+            flushPipeline(&toBeDecodedq, &toBeExecutedq, decodedInst.immediateVal);
+        }
+        break;
+
+    // ANDI opcode. R1 <- R1 & IMM.
+    case 5:
+        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
+        newVal = srcRegVal & decodedInst.immediateVal;
+        regFile.generalRegisterFile[decodedInst.srcRegister] = newVal;
+        updateStatusRegister(srcRegVal, '0', newVal, decodedInst);
+        TRACE("ANDI : R%d Value : %d, Immediate Value : %d, Value in Register %d After ANDI %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.immediateVal, decodedInst.srcRegister, newVal);
+        break;
+
+    // EOR Opcode. R1 <- R1 XOR R2
+    case 6:
+        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
+        dstRegVal = regFile.generalRegisterFile[decodedInst.dstRegister];
+        newVal = srcRegVal ^ dstRegVal;
+        regFile.generalRegisterFile[decodedInst.srcRegister] = newVal;
+        updateStatusRegister(srcRegVal, dstRegVal, newVal, decodedInst);
+        TRACE("EOR : R%d Value : %d, R%d Value : %d, Value in Register %d After EOR %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.dstRegister, dstRegVal, decodedInst.srcRegister, newVal);
+        break;
+
+    // BR Opcode. PC = R1 concat. R2
+    case 7:
+        char newAddr[3];
+        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
+        dstRegVal = regFile.generalRegisterFile[decodedInst.dstRegister];
+        newAddr[0] = srcRegVal;
+        newAddr[1] = dstRegVal;
+        newAddr[2] = '\0';
+        short newAddress = (srcRegVal * 256) | dstRegVal;
+        regFile.PCRegister = newAddress;
+        TRACE("BR : R%d Value : %d, R%d Value : %d, Value in PC After BR %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.dstRegister, dstRegVal, regFile.PCRegister);
+        flushPipeline(&toBeDecodedq, &toBeExecutedq, (char)atoi(newAddr));
+        break;
+
+    // SAL opcode. R1 = R1 << IMM.
+    case 8:
+        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
+        newVal = shiftLeft(srcRegVal, decodedInst.immediateVal);
+        regFile.generalRegisterFile[decodedInst.srcRegister] = newVal;
+        updateStatusRegister(srcRegVal, '0', newVal, decodedInst);
+        TRACE("SAL : R%d Value : %d, R%d Value after being shifted to the left %d times : %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.srcRegister, decodedInst.immediateVal, newVal);
+        break;
+
+    // SAR opcode.
+    case 9:
+        srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
+        newVal = shiftRight(srcRegVal, decodedInst.immediateVal);
+        regFile.generalRegisterFile[decodedInst.srcRegister] = newVal;
+        updateStatusRegister(srcRegVal, '0', newVal, decodedInst);
+        TRACE("SAR : R%d Value : %d, R%d Value after being shifted to the right %d times : %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.srcRegister, decodedInst.immediateVal, newVal);
+        break;
+
+    // Load word from memory.
+    case 10:
+        memoryWord = loadDataByte(decodedInst.immediateVal);
         regFile.generalRegisterFile[decodedInst.srcRegister] = memoryWord;
-        printf("LDA : Word in Memory Address %d : %d, was loaded into Register %d\n", decodedInst.immediateVal, memoryWord, decodedInst.srcRegister);
+        TRACE("LDA : Word in Memory Address %d : %d, was loaded into Register %d\n", decodedInst.immediateVal, memoryWord, decodedInst.srcRegister);
         break;
 
     // Store word in memory.
     case 11:
         srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
-        dataMem.dataMemory[decodedInst.immediateVal] = srcRegVal;
-        printf("STR: Word in Register %d : %d , was loaded into memory at address %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.immediateVal);
+        storeDataByte(decodedInst.immediateVal, srcRegVal);
+        markDirty(decodedInst.immediateVal, 1);
+        TRACE("STR: Word in Register %d : %d , was loaded into memory at address %d\n", decodedInst.srcRegister, srcRegVal, decodedInst.immediateVal);
+        break;
+
+    // Bit manipulation group, the immediate holds the operation and its operand.
+    case 12:
+        executeBitOperation(decodedInst);
+        break;
+
+    // Vector group, the register field holds the operation and the destination vector register.
+    case 13:
+        executeVectorOperation(decodedInst);
+        break;
+
+    // Register indirect group, the immediate holds the operation, pointer pair and offset or count.
+    case 14:
+        executeMemoryOperation(decodedInst);
         break;
 
     default:
@@ -744,17 +1616,17 @@ bool moveThroughPipeline()
 {
     if (pipelineControl == 1)
     {
-        if (instMemory.instructionMemory[regFile.PCRegister] != 0 && regFile.PCRegister < INSTRUCTION_MEMORY_SIZE)
+        if (regFile.PCRegister >= 0 && regFile.PCRegister < INSTRUCTION_MEMORY_SIZE && instMemory.instructionMemory[regFile.PCRegister] != 0)
         { // atleast 1 instruction in the memory.
             if (instructionsStage.controlHazardFlag != true)
             {
                 initializePipeline();
             }
-            printf("-------------------------------------------------------\n");
-            printf("clock cycle: %d\n", clockCycle);
-            printf("Instruction  fetched: %d\n", instructionsStage.fetched);
-            printf("Instruction  decoded: %d\n", instructionsStage.decoded);
-            printf("Instruction  executed: %d\n", instructionsStage.executed);
+            TRACE("-------------------------------------------------------\n");
+            TRACE("clock cycle: %d\n", clockCycle);
+            TRACE("Instruction  fetched: %d\n", instructionsStage.fetched);
+            TRACE("Instruction  decoded: %d\n", instructionsStage.decoded);
+            TRACE("Instruction  executed: %d\n", instructionsStage.executed);
             pipelineControl++;
             return true;
         }
@@ -766,7 +1638,7 @@ bool moveThroughPipeline()
     else if (pipelineControl == 2)
     {
         // atleast 2 instruction in the memory.
-        if (instMemory.instructionMemory[regFile.PCRegister] != 0 && regFile.PCRegister < INSTRUCTION_MEMORY_SIZE)
+        if (regFile.PCRegister >= 0 && regFile.PCRegister < INSTRUCTION_MEMORY_SIZE && instMemory.instructionMemory[regFile.PCRegister] != 0)
         {
             pipeline.currInstructionFetched = fetchInstruction();
             toBeDecodedEnqueue(&toBeDecodedq, pipeline.currInstructionFetched);
@@ -791,11 +1663,11 @@ bool moveThroughPipeline()
                 instructionsStage.fetched = 0;
             }
 
-            printf("-------------------------------------------------------\n");
-            printf("clock cycle: %d\n", clockCycle);
-            printf("Instruction  fetched: %d\n", instructionsStage.fetched);
-            printf("Instruction  decoded: %d\n", instructionsStage.decoded);
-            printf("Instruction  executed: %d\n", instructionsStage.executed);
+            TRACE("-------------------------------------------------------\n");
+            TRACE("clock cycle: %d\n", clockCycle);
+            TRACE("Instruction  fetched: %d\n", instructionsStage.fetched);
+            TRACE("Instruction  decoded: %d\n", instructionsStage.decoded);
+            TRACE("Instruction  executed: %d\n", instructionsStage.executed);
             pipelineControl++;
             return true;
         }
@@ -806,18 +1678,18 @@ bool moveThroughPipeline()
             toBeExecutedEnqueue(&toBeExecutedq, pipeline.currInstructionDecoded);
             instructionsStage.fetched = 0;
             instructionsStage.decoded++;
-            printf("-------------------------------------------------------\n");
-            printf("clock cycle: %d\n", clockCycle);
-            printf("Instruction  fetched: %d\n", instructionsStage.fetched);
-            printf("Instruction  decoded: %d\n", instructionsStage.decoded);
-            printf("Instruction  executed: %d\n", instructionsStage.executed);
+            TRACE("-------------------------------------------------------\n");
+            TRACE("clock cycle: %d\n", clockCycle);
+            TRACE("Instruction  fetched: %d\n", instructionsStage.fetched);
+            TRACE("Instruction  decoded: %d\n", instructionsStage.decoded);
+            TRACE("Instruction  executed: %d\n", instructionsStage.executed);
             pipelineControl++;
             return true;
         }
     }
     else
     {
-        if (instMemory.instructionMemory[regFile.PCRegister] != 0 && regFile.PCRegister < INSTRUCTION_MEMORY_SIZE)
+        if (regFile.PCRegister >= 0 && regFile.PCRegister < INSTRUCTION_MEMORY_SIZE && instMemory.instructionMemory[regFile.PCRegister] != 0)
         { // general case when there are more than 2 instructions in memory.
             pipeline.currInstructionFetched = fetchInstruction();
             toBeDecodedEnqueue(&toBeDecodedq, pipeline.currInstructionFetched);
@@ -851,11 +1723,11 @@ bool moveThroughPipeline()
 
             instructionsStage.decoded++;
 
-            printf("-------------------------------------------------------\n");
-            printf("clock cycle: %d\n", clockCycle);
-            printf("Instruction  fetched: %d\n", instructionsStage.fetched);
-            printf("Instruction  decoded: %d\n", instructionsStage.decoded);
-            printf("Instruction  executed: %d\n", instructionsStage.executed);
+            TRACE("-------------------------------------------------------\n");
+            TRACE("clock cycle: %d\n", clockCycle);
+            TRACE("Instruction  fetched: %d\n", instructionsStage.fetched);
+            TRACE("Instruction  decoded: %d\n", instructionsStage.decoded);
+            TRACE("Instruction  executed: %d\n", instructionsStage.executed);
             executeInstruction(tempdecodedInst);
             return true;
         } // last few instructions in the pipeline. No need to fetch more instructions.
@@ -870,11 +1742,11 @@ bool moveThroughPipeline()
             instructionsStage.executed++;
             instructionsStage.decoded++;
 
-            printf("-------------------------------------------------------\n");
-            printf("clock cycle: %d\n", clockCycle);
-            printf("Instruction  fetched: %d\n", instructionsStage.fetched);
-            printf("Instruction  decoded: %d\n", instructionsStage.decoded);
-            printf("Instruction  executed: %d\n", instructionsStage.executed);
+            TRACE("-------------------------------------------------------\n");
+            TRACE("clock cycle: %d\n", clockCycle);
+            TRACE("Instruction  fetched: %d\n", instructionsStage.fetched);
+            TRACE("Instruction  decoded: %d\n", instructionsStage.decoded);
+            TRACE("Instruction  executed: %d\n", instructionsStage.executed);
             executeInstruction(tempdecodedInst);
             return true;
         }
@@ -894,12 +1766,13 @@ bool moveThroughPipeline()
                 instructionsStage.executed++;
             }
 
-            printf("-------------------------------------------------------\n");
-            printf("clock cycle: %d\n", clockCycle);
-            printf("Instruction  fetched: %d\n", instructionsStage.fetched);
-            printf("Instruction  decoded: %d\n", instructionsStage.decoded);
-            printf("Instruction  executed: %d\n", instructionsStage.executed);
+            TRACE("-------------------------------------------------------\n");
+            TRACE("clock cycle: %d\n", clockCycle);
+            TRACE("Instruction  fetched: %d\n", instructionsStage.fetched);
+            TRACE("Instruction  decoded: %d\n", instructionsStage.decoded);
+            TRACE("Instruction  executed: %d\n", instructionsStage.executed);
             executeInstruction(tempdecodedInst);
+            return true;
         }
 
         else
@@ -912,47 +1785,2955 @@ bool moveThroughPipeline()
     }
 }
 
-/* runProgram() method, it's called to initalize the pipeline queues effectively, and run the program by moving through
-    the pipeline, until there are no more instructions left.
+/* Assembler passes. They work on the assembled 16 bit words. A branch is resolved in the execute stage, after the
+    two instructions following it have been fetched. flushPipeline() discards those two, so execution continues
+    BRANCH_FALL_THROUGH instructions after a BEQZ (BNEZ), plus the immediate when the branch is taken. A laid out
+    program (skipBranchShadows) skips the two slots at fetch instead and only flushes after a taken branch. Either way
+    instructions in those two slots only run when another branch jumps to them.
+
+    instructionEffects summarises the registers and data memory an instruction reads and writes. Memory accesses
+    are a static address range, or UNKNOWN_ADDRESS for the register indirect group. statusWritten holds the flags of
+    the status register an instruction sets (bit 4 C, 3 V, 2 N, 1 S, 0 Z). No instruction reads them, but the status
+    register is part of the final state, so the passes treat every flag as live at the end of a block. A pure
+    instruction has no effect besides writing its registers and its flags.
 */
-void runProgram()
+
+typedef struct
 {
-    bool flag = true;
-    initializeToBeDecodedQueue(&toBeDecodedq);
-    initializeToBeExecutedQueue(&toBeExecutedq);
-    printf("Running Program,instructions not in the pipeline are labeled Instruction (stage): 0 \n");
+    uint64_t registersRead;
+    uint64_t registersWritten;
+    int statusWritten;
+    int memoryRead;
+    int memoryWritten;
+    int memoryBytes;
+    bool isBranch;
+    bool isPure;
+} instructionEffects;
 
-    while (flag == true)
+uint64_t registerBits(int firstRegister, int count)
+{
+    uint64_t bits = 0;
+    for (int i = 0; i < count; i++)
     {
-        flag = moveThroughPipeline(clockCycle);
-        clockCycle++;
+        bits |= 1ULL << ((firstRegister + i) % generalPuproseRegister);
     }
+    return bits;
+}
 
-    if (clockCycle > 1)
-    {
-        // print the memory and registers after full execution.
-        printf("Program executed successfully -----------------------------------\n");
-        int j;
-        for (j = 0; j < DATA_MEMORY_SIZE; j++)
-        {
-            printf("%d ", dataMem.dataMemory[j]);
-        }
+instructionEffects getInstructionEffects(short instruction)
+{
+    decodedInstruction decodedInst = decodeInstruction(instruction);
+    instructionEffects effects = {0, 0, 0, -1, -1, 1, false, true};
+    int src = decodedInst.srcRegister;
+    int dst = decodedInst.dstRegister;
+    int field = decodedInst.immediateVal & 0b111111;
 
-        printf("\n");
+    switch (decodedInst.opcode)
+    {
+    case 0:
+    case 1:
+    case 2:
+    case 6:
+        effects.registersRead = registerBits(src, 1) | registerBits(dst, 1);
+        effects.registersWritten = registerBits(src, 1);
+        // ADD sets C V N S Z, SUB sets V N S Z, MUL and EOR only N and Z.
+        effects.statusWritten = decodedInst.opcode == 0 ? 0b11111 : decodedInst.opcode == 1 ? 0b01111 : 0b00101;
+        break;
+    case 3:
+        effects.registersWritten = registerBits(src, 1);
+        break;
+    case 4:
+    case 15:
+        effects.registersRead = registerBits(src, 1);
+        effects.isBranch = true;
+        effects.isPure = false;
+        break;
+    case 7:
+        effects.registersRead = registerBits(src, 1) | registerBits(dst, 1);
+        effects.isBranch = true;
+        effects.isPure = false;
+        break;
+    case 10:
+        effects.registersWritten = registerBits(src, 1);
+        effects.memoryRead = field;
+        break;
+    case 11:
+        effects.registersRead = registerBits(src, 1);
+        effects.memoryWritten = field;
+        effects.isPure = false;
+        break;
+    case 12:
+        effects.registersRead = registerBits(src, 1);
+        effects.registersWritten = registerBits(src, 1);
+        effects.statusWritten = 0b00101;
+        if ((field >> 3) == 5)
+        {
+            effects.registersRead |= registerBits(field & 0b111, 1);
+        }
+        else if ((field >> 3) == 6)
+        {
+            effects.registersRead |= registerBits(field & 0b111, 2);
+        }
+        break;
+    case 13:
+    {
+        int operation = src >> 3;
+        uint64_t dstVector = registerBits((src & 0b111) * VECTOR_LANES, VECTOR_LANES);
+        effects.memoryBytes = VECTOR_LANES;
+        if (operation <= 3)
+        {
+            effects.registersRead = dstVector | registerBits((field & 0b111) * VECTOR_LANES, VECTOR_LANES);
+            effects.registersWritten = dstVector;
+        }
+        else if (operation <= 5)
+        {
+            effects.registersRead = dstVector;
+            effects.registersWritten = dstVector;
+        }
+        else if (operation == 6)
+        {
+            effects.registersWritten = dstVector;
+            effects.memoryRead = field * VECTOR_LANES;
+        }
+        else
+        {
+            effects.registersRead = dstVector;
+            effects.memoryWritten = field * VECTOR_LANES;
+            effects.isPure = false;
+        }
+        break;
+    }
+    case 14:
+    {
+        int operation = (field >> 4) & 0b11;
+        uint64_t pointerPair = registerBits(FIRST_POINTER_REGISTER + ((field >> 3) & 0b1) * 2, 2);
+        int count = (field & 0b111) + 1;
+        effects.registersRead = pointerPair;
+        if (operation == 0)
+        {
+            effects.registersWritten = registerBits(src, 1);
+            effects.memoryRead = UNKNOWN_ADDRESS;
+        }
+        else if (operation == 1)
+        {
+            effects.registersRead |= registerBits(src, 1);
+            effects.memoryWritten = UNKNOWN_ADDRESS;
+            effects.isPure = false;
+        }
+        else if (operation == 2)
+        {
+            effects.registersWritten = registerBits(src, count) | pointerPair;
+            effects.memoryRead = UNKNOWN_ADDRESS;
+        }
+        else
+        {
+            effects.registersRead |= registerBits(src, count);
+            effects.registersWritten = pointerPair;
+            effects.memoryWritten = UNKNOWN_ADDRESS;
+            effects.isPure = false;
+        }
+        break;
+    }
+    default:
+        // ANDI, SAL and SAR, register <- register op immediate.
+        effects.registersRead = registerBits(src, 1);
+        effects.registersWritten = registerBits(src, 1);
+        effects.statusWritten = 0b00101;
+        break;
+    }
+
+    return effects;
+}
+
+short encodeInstruction(int opcode, int reg, int field)
+{
+    return (short)((opcode << 12) | ((reg & 0b111111) << 6) | (field & 0b111111));
+}
+
+/* Returns the address BR jumps to, computed the same way executeInstruction() does. */
+int branchRegisterTarget(char highByte, char lowByte)
+{
+    return (short)((highByte * 256) | lowByte);
+}
+
+/* Finds the MOVIs that last set the two registers of the BR at i, scanning back to the start of its block. Returns
+    false when one of the registers is not set by a MOVI in the block, the target of the BR then being unknown.
+*/
+bool findBranchRegisterMovis(short *program, bool *leader, int i, int *highMovi, int *lowMovi)
+{
+    decodedInstruction decodedInst = decodeInstruction(program[i]);
+
+    *highMovi = -1;
+    *lowMovi = -1;
+    for (int j = i - 1; j >= 0; j--)
+    {
+        instructionEffects effects = getInstructionEffects(program[j]);
+        bool isMovi = decodeInstruction(program[j]).opcode == 3;
+        if (*highMovi == -1 && (effects.registersWritten & registerBits(decodedInst.srcRegister, 1)))
+        {
+            if (isMovi == false)
+            {
+                return false;
+            }
+            *highMovi = j;
+        }
+        if (*lowMovi == -1 && (effects.registersWritten & registerBits(decodedInst.dstRegister, 1)))
+        {
+            if (isMovi == false)
+            {
+                return false;
+            }
+            *lowMovi = j;
+        }
+        if (leader[j])
+        {
+            break;
+        }
+    }
+    return *highMovi >= 0 && *lowMovi >= 0;
+}
+
+/* findLeaders() marks the first instruction of every basic block, and the two slots after every branch in
+    shadowSlot. A BR target is only known when both of its registers were last set by a MOVI in the same block, if any
+    BR target is unknown the function returns false and the program cannot be split into blocks.
+*/
+bool findLeaders(short *program, int length, bool *leader, bool *shadowSlot)
+{
+    int i, j;
+    bool changed = true;
+
+    for (i = 0; i <= length; i++)
+    {
+        leader[i] = (i == 0 || i == length);
+        shadowSlot[i] = false;
+    }
+
+    for (i = 0; i < length; i++)
+    {
+        decodedInstruction decodedInst = decodeInstruction(program[i]);
+        if (program[i] == 0)
+        {
+            // fetching stops at an all zero word (ADD R0, R0), so it ends a block like a branch.
+            leader[i] = true;
+            leader[i + 1] = true;
+        }
+        if (decodedInst.opcode == 4 || decodedInst.opcode == 7 || decodedInst.opcode == 15)
+        {
+            for (j = i + 1; j <= i + BRANCH_FALL_THROUGH && j < length; j++)
+            {
+                shadowSlot[j] = j < i + BRANCH_FALL_THROUGH;
+                leader[j] = (j == i + 1 || j == i + BRANCH_FALL_THROUGH) ? true : leader[j];
+            }
+        }
+        if ((decodedInst.opcode == 4 || decodedInst.opcode == 15) && i + BRANCH_FALL_THROUGH + decodedInst.immediateVal < length)
+        {
+            leader[i + BRANCH_FALL_THROUGH + decodedInst.immediateVal] = true;
+        }
+    }
+
+    // adding a BR target splits a block, which can change the known registers of another BR.
+    while (changed)
+    {
+        changed = false;
+        for (i = 0; i < length; i++)
+        {
+            decodedInstruction decodedInst = decodeInstruction(program[i]);
+            if (decodedInst.opcode != 7)
+            {
+                continue;
+            }
+
+            int highMovi, lowMovi;
+            if (findBranchRegisterMovis(program, leader, i, &highMovi, &lowMovi) == false)
+            {
+                return false;
+            }
+
+            int target = branchRegisterTarget(decodeInstruction(program[highMovi]).immediateVal,
+                                              decodeInstruction(program[lowMovi]).immediateVal);
+            if (target >= 0 && target < length && leader[target] == false)
+            {
+                leader[target] = true;
+                changed = true;
+            }
+        }
+    }
+
+    return true;
+}
+
+/* optimizeProgram() is a peephole pass over every basic block :
+    1. Constant folding, an ALU instruction whose operands are known constants becomes a MOVI when the flags it sets
+       are set again later in the block, and a MOVI of the value the register already holds is removed.
+    2. Strength reduction, MUL by a known power of two becomes SAL.
+    3. Redundant load elimination, an LDR of an address whose value is still in the target register is removed.
+    4. Dead write elimination, a pure instruction whose registers and flags are all overwritten later in the block, and
+       an STR to an address stored to again later in the block without being read in between, are removed.
+    5. Branch threading, a BEQZ (BNEZ) that lands on a BEQZ (BNEZ) testing the same register jumps straight to its
+       target.
+   Instructions are only removed when no BR is present, since BR targets are absolute addresses held in registers.
+   The branch offsets are fixed up after the removed instructions are squeezed out, and a report is printed.
+*/
+void optimizeProgram(short *program, int *programLength)
+{
+    int length = *programLength;
+    bool leader[INSTRUCTION_MEMORY_SIZE + 1];
+    bool shadowSlot[INSTRUCTION_MEMORY_SIZE + 1];
+    bool removed[INSTRUCTION_MEMORY_SIZE];
+    int liveFlagsAfter[INSTRUCTION_MEMORY_SIZE];
+    int newIndex[INSTRUCTION_MEMORY_SIZE + 1];
+    int redundantMoves = 0, redundantLoads = 0, deadWrites = 0, deadStores = 0;
+    int folded = 0, strengthReduced = 0, threaded = 0;
+    bool allowRemoval = true;
+    int i, j, start, end;
+
+    if (findLeaders(program, length, leader, shadowSlot) == false)
+    {
+        REPORT("Optimizer : skipped, the program has a BR whose target is not a constant.\n");
+        return;
+    }
+
+    for (i = 0; i < length; i++)
+    {
+        removed[i] = false;
+        if (decodeInstruction(program[i]).opcode == 7)
+        {
+            allowRemoval = false;
+        }
+    }
+
+    for (start = 0; start < length; start = j)
+    {
+        bool known[generalPuproseRegister] = {false};
+        char value[generalPuproseRegister] = {0};
+        int holder[64];
+
+        for (j = 0; j < 64; j++)
+        {
+            holder[j] = -1;
+        }
+
+        // the flags still read as part of the final state after each instruction, all of them at the end of the block.
+        end = start + 1;
+        while (end < length && leader[end] == false)
+        {
+            end++;
+        }
+        int liveFlags = 0b11111;
+        for (j = end - 1; j >= start; j--)
+        {
+            liveFlagsAfter[j] = liveFlags;
+            liveFlags &= ~getInstructionEffects(program[j]).statusWritten;
+        }
+
+        // forward pass, constant folding, strength reduction and redundant moves and loads.
+        for (j = start; j < end; j++)
+        {
+            decodedInstruction decodedInst = decodeInstruction(program[j]);
+            int reg = decodedInst.srcRegister;
+            int other = decodedInst.dstRegister;
+            bool removable = allowRemoval && shadowSlot[j] == false;
+            bool foldable = true;
+            char result = 0;
+
+            switch (decodedInst.opcode)
+            {
+            case 0:
+                result = value[reg] + value[other];
+                foldable = known[reg] && known[other];
+                break;
+            case 1:
+                result = value[reg] - value[other];
+                foldable = known[reg] && known[other];
+                break;
+            case 2:
+                result = value[reg] * value[other];
+                foldable = known[reg] && known[other];
+                break;
+            case 5:
+                result = value[reg] & decodedInst.immediateVal;
+                foldable = known[reg];
+                break;
+            case 6:
+                result = value[reg] ^ value[other];
+                foldable = known[reg] && known[other];
+                break;
+            case 8:
+                result = shiftLeft(value[reg], decodedInst.immediateVal);
+                foldable = known[reg] && decodedInst.immediateVal >= 0;
+                break;
+            case 9:
+                result = shiftRight(value[reg], decodedInst.immediateVal);
+                foldable = known[reg] && decodedInst.immediateVal >= 0;
+                break;
+            default:
+                foldable = false;
+            }
+
+            if (foldable && result >= -32 && result <= 31 &&
+                (getInstructionEffects(program[j]).statusWritten & liveFlagsAfter[j]) == 0)
+            {
+                program[j] = encodeInstruction(3, reg, result);
+                decodedInst = decodeInstruction(program[j]);
+                folded++;
+            }
+            else if (decodedInst.opcode == 2 && known[other] && value[other] != 0 &&
+                     (value[other] & (value[other] - 1)) == 0)
+            {
+                program[j] = encodeInstruction(8, reg, __builtin_ctz((unsigned char)value[other]));
+                strengthReduced++;
+            }
+            else if (decodedInst.opcode == 3 && known[reg] && value[reg] == decodedInst.immediateVal && removable)
+            {
+                removed[j] = true;
+                redundantMoves++;
+                continue;
+            }
+            else if (decodedInst.opcode == 10 && holder[decodedInst.immediateVal] == reg && removable)
+            {
+                removed[j] = true;
+                redundantLoads++;
+                continue;
+            }
+
+            // track the known registers and which register holds each static address.
+            instructionEffects effects = getInstructionEffects(program[j]);
+            for (int r = 0; r < generalPuproseRegister; r++)
+            {
+                if (effects.registersWritten & registerBits(r, 1))
+                {
+                    known[r] = false;
+                }
+            }
+            for (int a = 0; a < 64; a++)
+            {
+                bool overwritten = effects.memoryWritten == UNKNOWN_ADDRESS ||
+                                   (effects.memoryWritten >= 0 && a >= effects.memoryWritten &&
+                                    a < effects.memoryWritten + effects.memoryBytes);
+                if (overwritten || (holder[a] >= 0 && (effects.registersWritten & registerBits(holder[a], 1))))
+                {
+                    holder[a] = -1;
+                }
+            }
+            if (decodedInst.opcode == 3)
+            {
+                known[reg] = true;
+                value[reg] = decodedInst.immediateVal;
+            }
+            else if (decodedInst.opcode == 10 || decodedInst.opcode == 11)
+            {
+                holder[decodedInst.immediateVal] = reg;
+            }
+        }
+
+        // backward pass, dead register writes and dead stores. Every register and flag is live at the end of the block.
+        uint64_t live = ~0ULL;
+        liveFlags = 0b11111;
+        bool overwritten[64] = {false};
+        for (int k = j - 1; k >= start; k--)
+        {
+            if (removed[k])
+            {
+                continue;
+            }
+
+            instructionEffects effects = getInstructionEffects(program[k]);
+            bool removable = allowRemoval && shadowSlot[k] == false && program[k] != 0;
+            int opcode = decodeInstruction(program[k]).opcode;
+
+            if (removable && effects.isPure && effects.registersWritten != 0 && (effects.registersWritten & live) == 0 &&
+                (effects.statusWritten & liveFlags) == 0)
+            {
+                removed[k] = true;
+                deadWrites++;
+                continue;
+            }
+            if (removable && opcode == 11 && overwritten[effects.memoryWritten])
+            {
+                removed[k] = true;
+                deadStores++;
+                continue;
+            }
+
+            live = (live & ~effects.registersWritten) | effects.registersRead;
+            liveFlags &= ~effects.statusWritten;
+            for (int a = 0; a < 64; a++)
+            {
+                if (effects.memoryWritten >= 0 && a >= effects.memoryWritten && a < effects.memoryWritten + effects.memoryBytes)
+                {
+                    overwritten[a] = true;
+                }
+                if (effects.memoryRead == UNKNOWN_ADDRESS ||
+                    (effects.memoryRead >= 0 && a >= effects.memoryRead && a < effects.memoryRead + effects.memoryBytes))
+                {
+                    overwritten[a] = false;
+                }
+            }
+        }
+    }
+
+    // branch threading, removed instructions have no effect so a branch landing on one lands on the next survivor.
+    for (i = 0; i < length; i++)
+    {
+        decodedInstruction branch = decodeInstruction(program[i]);
+        while (removed[i] == false && (branch.opcode == 4 || branch.opcode == 15))
+        {
+            int target = i + BRANCH_FALL_THROUGH + branch.immediateVal;
+            while (target < length && removed[target])
+            {
+                target++;
+            }
+            if (target >= length || target == i)
+            {
+                break;
+            }
+
+            decodedInstruction next = decodeInstruction(program[target]);
+            int offset = target + BRANCH_FALL_THROUGH + next.immediateVal - (i + BRANCH_FALL_THROUGH);
+            if (next.opcode != branch.opcode || next.srcRegister != branch.srcRegister || offset > 0b111111)
+            {
+                break;
+            }
+
+            program[i] = encodeInstruction(branch.opcode, branch.srcRegister, offset);
+            branch = decodeInstruction(program[i]);
+            threaded++;
+        }
+    }
+
+    // squeeze out the removed instructions and fix up the BEQZ offsets.
+    int newLength = 0;
+    for (i = 0; i <= length; i++)
+    {
+        newIndex[i] = newLength;
+        if (i < length && removed[i] == false)
+        {
+            newLength++;
+        }
+    }
+
+    for (i = 0; i < length; i++)
+    {
+        decodedInstruction decodedInst = decodeInstruction(program[i]);
+        if (removed[i] == false && (decodedInst.opcode == 4 || decodedInst.opcode == 15))
+        {
+            int target = i + BRANCH_FALL_THROUGH + decodedInst.immediateVal;
+            int newTarget = target < length ? newIndex[target] : newLength + (target - length);
+            program[i] = encodeInstruction(decodedInst.opcode, decodedInst.srcRegister, newTarget - (newIndex[i] + BRANCH_FALL_THROUGH));
+        }
+    }
+
+    for (i = 0; i < length; i++)
+    {
+        if (removed[i] == false)
+        {
+            program[newIndex[i]] = program[i];
+        }
+    }
+
+    *programLength = newLength;
+    REPORT("Optimizer : %d instructions before, %d after, removed %d redundant MOVI, %d redundant LDR, "
+           "%d dead register writes and %d dead STR, folded %d constants, reduced %d MUL, threaded %d branches%s\n",
+           length, newLength, redundantMoves, redundantLoads, deadWrites, deadStores, folded, strengthReduced,
+           threaded, allowRemoval ? "" : " (BR present, no instructions removed)");
+}
+
+/* pipelineDescription is the timing model the scheduler works with. branchPenalty is the number of cycles lost to
+    refill the pipeline after every executed branch, and the latencies are the extra cycles before the result of a load
+    (LDR, LDRX, LDM, VLDR) or a MUL can be used by the next instruction. "harvard" describes this simulator, where every
+    result is available to the next instruction and flushPipeline() costs two cycles; "classic5" is a five stage pipeline
+    with a load use delay and a multi-cycle multiplier.
+*/
+
+typedef struct
+{
+    char *name;
+    int stages;
+    int branchPenalty;
+    int loadLatency;
+    int multiplyLatency;
+} pipelineDescription;
+
+pipelineDescription pipelineDescriptions[] = {
+    {"harvard", 3, 2, 0, 0},
+    {"classic5", 5, 2, 1, 2},
+};
+
+int getResultLatency(short instruction, pipelineDescription *description)
+{
+    decodedInstruction decodedInst = decodeInstruction(instruction);
+    int field = decodedInst.immediateVal & 0b111111;
+
+    if (decodedInst.opcode == 10 || (decodedInst.opcode == 14 && ((field >> 4) == 0 || (field >> 4) == 2)) ||
+        (decodedInst.opcode == 13 && (decodedInst.srcRegister >> 3) == 6))
+    {
+        return description->loadLatency;
+    }
+    if (decodedInst.opcode == 2)
+    {
+        return description->multiplyLatency;
+    }
+    return 0;
+}
+
+/* Returns the cycles an in-order pipeline needs to issue the instructions, including the stalls on results that are
+    not ready yet.
+*/
+int predictBlockCycles(short *code, int count, pipelineDescription *description)
+{
+    int ready[generalPuproseRegister] = {0};
+    int issue = -1;
+
+    for (int k = 0; k < count; k++)
+    {
+        instructionEffects effects = getInstructionEffects(code[k]);
+        int earliest = issue + 1;
+        for (int r = 0; r < generalPuproseRegister; r++)
+        {
+            if ((effects.registersRead & registerBits(r, 1)) && ready[r] > earliest)
+            {
+                earliest = ready[r];
+            }
+        }
+        issue = earliest;
+        for (int r = 0; r < generalPuproseRegister; r++)
+        {
+            if (effects.registersWritten & registerBits(r, 1))
+            {
+                ready[r] = issue + 1 + getResultLatency(code[k], description);
+            }
+        }
+    }
+
+    return issue + 1;
+}
+
+/* Returns true when the instruction with effects b has to stay after the one with effects a, because of a register or
+    memory dependency between them, because both set the same flag of the status register or because one of them is a
+    branch (the scheduler also marks the zero word ending a program as one).
+*/
+bool dependsOn(const instructionEffects *a, const instructionEffects *b)
+{
+    if (a->isBranch || b->isBranch)
+    {
+        return true;
+    }
+    if ((a->registersWritten & (b->registersRead | b->registersWritten)) || (a->registersRead & b->registersWritten) ||
+        (a->statusWritten & b->statusWritten))
+    {
+        return true;
+    }
+
+    // two accesses to memory conflict unless both are reads or both have static, disjoint address ranges.
+    int aAddress = a->memoryWritten != -1 ? a->memoryWritten : a->memoryRead;
+    int bAddress = b->memoryWritten != -1 ? b->memoryWritten : b->memoryRead;
+    if (aAddress == -1 || bAddress == -1 || (a->memoryWritten == -1 && b->memoryWritten == -1))
+    {
+        return false;
+    }
+    if (aAddress == UNKNOWN_ADDRESS || bAddress == UNKNOWN_ADDRESS)
+    {
+        return true;
+    }
+    return aAddress < bAddress + b->memoryBytes && bAddress < aAddress + a->memoryBytes;
+}
+
+/* scheduleProgram() reorders the instructions inside every basic block to hide the result latencies of the chosen
+    pipeline. Every instruction of a block is decoded once, then the dependency graph of the block (successor lists,
+    the number of unscheduled predecessors and the longest latency path to the end of the block) is built once and the
+    block is list scheduled from the ready list, picking among the instructions whose operands are ready the one with
+    the longest path. A branch always stays last in
+    its block, so block boundaries and branch offsets do not move. A block keeps its order unless the schedule saves
+    cycles. A pipeline without load or multiply latency has nothing to hide, the program is left as is and reported so.
+    The two instructions after a branch are always discarded by flushPipeline(), so there are no branch slots that can
+    legally be filled with work from before the branch; those shadow slots are reported instead.
+    The prediction counts every block once, skipping the branch shadows, plus the pipeline fill and the refill after
+    every branch.
+*/
+void scheduleProgram(short *program, int programLength, char *pipelineName)
+{
+    pipelineDescription *description = NULL;
+    pipelineDescription custom = {"custom", 3, 2, 0, 0};
+    bool leader[INSTRUCTION_MEMORY_SIZE + 1];
+    bool shadowSlot[INSTRUCTION_MEMORY_SIZE + 1];
+    int cyclesBefore = 0, cyclesAfter = 0, moved = 0, branches = 0, shadowSlots = 0;
+    int start, end, i, j;
+
+    for (i = 0; i < (int)(sizeof(pipelineDescriptions) / sizeof(pipelineDescriptions[0])); i++)
+    {
+        if (strcmp(pipelineDescriptions[i].name, pipelineName) == 0)
+        {
+            description = &pipelineDescriptions[i];
+        }
+    }
+    if (description == NULL && sscanf(pipelineName, "%d,%d,%d,%d", &custom.stages, &custom.branchPenalty,
+                                      &custom.loadLatency, &custom.multiplyLatency) == 4)
+    {
+        description = &custom;
+    }
+    if (description == NULL)
+    {
+        REPORT("Scheduler : unknown pipeline %s, use harvard, classic5 or stages,branch,load,mul.\n", pipelineName);
+        return;
+    }
+    if (description->loadLatency <= 0 && description->multiplyLatency <= 0)
+    {
+        REPORT("Scheduler (%s) : every result is ready for the next instruction, there are no latencies to hide and "
+               "the program is left as is\n",
+               description->name);
+        return;
+    }
+    if (findLeaders(program, programLength, leader, shadowSlot) == false)
+    {
+        REPORT("Scheduler : skipped, the program has a BR whose target is not a constant.\n");
+        return;
+    }
+
+    // successors of the instructions of a block, those of instruction j are successors[firstSuccessor[j] ...].
+    short *successors = malloc(((size_t)programLength * programLength / 2 + 1) * sizeof(short));
+    if (successors == NULL)
+    {
+        printf("Memory allocation failed.\n");
+        exit(1);
+    }
+
+    for (start = 0; start < programLength; start = end)
+    {
+        short block[INSTRUCTION_MEMORY_SIZE];
+        short scheduled[INSTRUCTION_MEMORY_SIZE];
+        instructionEffects effects[INSTRUCTION_MEMORY_SIZE];
+        int latency[INSTRUCTION_MEMORY_SIZE];
+        int firstSuccessor[INSTRUCTION_MEMORY_SIZE + 1];
+        int predecessors[INSTRUCTION_MEMORY_SIZE];
+        int pathLength[INSTRUCTION_MEMORY_SIZE];
+        int readyAt[INSTRUCTION_MEMORY_SIZE];
+        short readyList[INSTRUCTION_MEMORY_SIZE];
+        int count, readyCount = 0, edges = 0;
+
+        for (end = start + 1; end < programLength && leader[end] == false; end++)
+        {
+        }
+        count = end - start;
+
+        if (shadowSlot[start])
+        {
+            shadowSlots += count;
+            continue;
+        }
+
+        for (j = 0; j < count; j++)
+        {
+            block[j] = program[start + j];
+            effects[j] = getInstructionEffects(block[j]);
+            // nothing moves across the zero word that ends the program.
+            effects[j].isBranch |= block[j] == 0;
+            latency[j] = getResultLatency(block[j], description);
+            predecessors[j] = 0;
+            readyAt[j] = 0;
+        }
+        if (getInstructionEffects(program[end - 1]).isBranch)
+        {
+            branches++;
+        }
+
+        // the dependency graph, every pair of the block is compared once.
+        for (j = 0; j < count; j++)
+        {
+            firstSuccessor[j] = edges;
+            for (int k = j + 1; k < count; k++)
+            {
+                if (dependsOn(&effects[j], &effects[k]))
+                {
+                    successors[edges++] = k;
+                    predecessors[k]++;
+                }
+            }
+        }
+        firstSuccessor[count] = edges;
+
+        // longest latency path from every instruction to the end of the block, the scheduling priority.
+        for (j = count - 1; j >= 0; j--)
+        {
+            pathLength[j] = 1 + latency[j];
+            for (int e = firstSuccessor[j]; e < firstSuccessor[j + 1]; e++)
+            {
+                if (1 + latency[j] + pathLength[successors[e]] > pathLength[j])
+                {
+                    pathLength[j] = 1 + latency[j] + pathLength[successors[e]];
+                }
+            }
+            if (predecessors[j] == 0)
+            {
+                readyList[readyCount++] = j;
+            }
+        }
+
+        // list scheduling, cycle by cycle. An instruction joins the ready list once everything it depends on is issued.
+        int cycle = 0;
+        for (int n = 0; n < count; n++)
+        {
+            int best = 0;
+            for (int r = 1; r < readyCount; r++)
+            {
+                int c = readyList[r], b = readyList[best];
+                bool ready = readyAt[c] <= cycle;
+                bool bestReady = readyAt[b] <= cycle;
+                if ((ready && bestReady == false) ||
+                    (ready && bestReady && (pathLength[c] > pathLength[b] || (pathLength[c] == pathLength[b] && c < b))) ||
+                    (ready == false && bestReady == false && (readyAt[c] < readyAt[b] || (readyAt[c] == readyAt[b] && c < b))))
+                {
+                    best = r;
+                }
+            }
+            int picked = readyList[best];
+            readyList[best] = readyList[--readyCount];
+
+            int issuedAt = readyAt[picked] > cycle ? readyAt[picked] : cycle;
+            scheduled[n] = block[picked];
+            cycle = issuedAt + 1;
+
+            for (int e = firstSuccessor[picked]; e < firstSuccessor[picked + 1]; e++)
+            {
+                int k = successors[e];
+                // a result is ready latency cycles after its producer issued, other dependencies only keep the order.
+                bool usesResult = effects[picked].registersWritten & effects[k].registersRead;
+                int available = issuedAt + 1 + (usesResult ? latency[picked] : 0);
+                readyAt[k] = available > readyAt[k] ? available : readyAt[k];
+                if (--predecessors[k] == 0)
+                {
+                    readyList[readyCount++] = k;
+                }
+            }
+        }
+
+        int before = predictBlockCycles(block, count, description);
+        int after = predictBlockCycles(scheduled, count, description);
+        cyclesBefore += before;
+        if (after < before)
+        {
+            cyclesAfter += after;
+            for (j = 0; j < count; j++)
+            {
+                moved += program[start + j] != scheduled[j];
+                program[start + j] = scheduled[j];
+            }
+        }
+        else
+        {
+            cyclesAfter += before;
+        }
+    }
+
+    free(successors);
+
+    int fixedCycles = description->stages - 1 + branches * description->branchPenalty;
+    REPORT("Scheduler (%s) : predicted %d cycles before scheduling, %d after, %d instructions moved, "
+           "%d branch shadow slots left unfilled\n",
+           description->name, cyclesBefore + fixedCycles, cyclesAfter + fixedCycles, moved, shadowSlots);
+}
+
+/* Profile guided layout. writeProfile() saves the cycles of a run and, for every conditional branch that executed,
+    how often it ran and how often it was taken. A laid out program runs with skipBranchShadows, where a taken branch
+    costs the refill of the pipeline and a branch that falls through costs nothing, so layoutProgram() lays out the
+    program such that the usual direction of every branch is the fall through.
+    There is no unconditional or backward jump to link the blocks again, so a mostly taken branch at i is inverted
+    (BEQZ <-> BNEZ) and its target is duplicated after it: the code from the target to the end follows the branch and
+    ends with a zero word, and the old fall through code, up to the end, is laid out after that and becomes the taken
+    path of the inverted branch. The program keeps its meaning and only grows.
+    BR targets are absolute, so the MOVIs loading them (found as in findLeaders()) are rewritten with the new address of
+    the target; the code from the target on exists twice, and a BR keeps jumping inside its own copy. A branch is not
+    inverted when a moved BR target would need a byte MOVI cannot load (outside 0 - 31).
+    The prediction starts from the profiled cycles : every branch cost the refill of the pipeline in the profiled run,
+    a kept branch now only costs it when taken and an inverted one when it used to fall through.
+*/
+void writeProfile(char *profilePath)
+{
+    FILE *profile = fopen(profilePath, "w");
+    if (profile == NULL)
+    {
+        REPORT("Error in opening profile file %s\n", profilePath);
+        return;
+    }
+
+    fprintf(profile, "cycles %d\n", clockCycle - 1);
+    for (int i = 0; i < INSTRUCTION_MEMORY_SIZE; i++)
+    {
+        if (branchExecutions[i] > 0)
+        {
+            fprintf(profile, "%d %d %d\n", i, branchExecutions[i], branchTakenExecutions[i]);
+        }
+    }
+    fclose(profile);
+}
+
+// lays the program out from the branch counts of a profiled run that took profiledCycles cycles.
+void layoutProgramWithCounts(short *program, int *programLength, const int *executions, const int *takenExecutions,
+                             long long profiledCycles)
+{
+    int origin[INSTRUCTION_MEMORY_SIZE];
+    bool counted[INSTRUCTION_MEMORY_SIZE];
+    bool leader[INSTRUCTION_MEMORY_SIZE + 1];
+    bool shadowSlot[INSTRUCTION_MEMORY_SIZE + 1];
+    int penalty = pipelineDescriptions[0].branchPenalty;
+    int length = *programLength, inverted = 0, i, j;
+    long long savedCycles = 0;
+
+    if (findLeaders(program, length, leader, shadowSlot) == false)
+    {
+        REPORT("Layout : skipped, the program has a BR whose target is not a constant.\n");
+        return;
+    }
+    for (i = 0; i < length; i++)
+    {
+        decodedInstruction decodedInst = decodeInstruction(program[i]);
+        origin[i] = i;
+        counted[i] = false;
+        // with skipBranchShadows a branch that falls through no longer refills the pipeline.
+        if (decodedInst.opcode == 4 || decodedInst.opcode == 15)
+        {
+            savedCycles += (long long)penalty * (executions[i] - takenExecutions[i]);
+        }
+    }
+
+    for (i = 0; i < length; i++)
+    {
+        decodedInstruction branch = decodeInstruction(program[i]);
+        int fallThrough = i + BRANCH_FALL_THROUGH;
+        int target = fallThrough + branch.immediateVal;
+        int suffix = length - target;
+        int newLength = fallThrough + suffix + 1 + (length - fallThrough);
+        bool legal = true;
+
+        if ((branch.opcode != 4 && branch.opcode != 15) || origin[i] < 0 ||
+            takenExecutions[origin[i]] * 2 <= executions[origin[i]])
+        {
+            continue;
+        }
+        if (target >= length || suffix + 1 > 0b111111 || newLength > INSTRUCTION_MEMORY_SIZE)
+        {
+            continue;
+        }
+
+        // the copy of the target code ends with a zero word, branches in it must not leave the copy.
+        for (j = target; j < length && legal; j++)
+        {
+            decodedInstruction decodedInst = decodeInstruction(program[j]);
+            if (decodedInst.opcode == 4 || decodedInst.opcode == 15)
+            {
+                legal = j + BRANCH_FALL_THROUGH <= length && j + BRANCH_FALL_THROUGH + decodedInst.immediateVal <= length;
+            }
+        }
+        // branches before the inverted one keep their targets, the shadow slots must not hold a branch.
+        short relaid[INSTRUCTION_MEMORY_SIZE];
+        int relaidOrigin[INSTRUCTION_MEMORY_SIZE];
+        int relaidFrom[INSTRUCTION_MEMORY_SIZE];
+        for (j = 0; j < fallThrough && legal; j++)
+        {
+            decodedInstruction decodedInst = decodeInstruction(program[j]);
+            relaid[j] = program[j];
+            relaidOrigin[j] = origin[j];
+            relaidFrom[j] = j;
+            if ((decodedInst.opcode != 4 && decodedInst.opcode != 15) || j == i)
+            {
+                continue;
+            }
+            int oldTarget = j + BRANCH_FALL_THROUGH + decodedInst.immediateVal;
+            int newTarget = oldTarget < fallThrough ? oldTarget
+                            : oldTarget >= target ? fallThrough + (oldTarget - target)
+                                                  : fallThrough + suffix + 1 + (oldTarget - fallThrough);
+            legal = j < i && oldTarget <= length && newTarget - (j + BRANCH_FALL_THROUGH) <= 0b111111;
+            relaid[j] = encodeInstruction(decodedInst.opcode, decodedInst.srcRegister, newTarget - (j + BRANCH_FALL_THROUGH));
+        }
+        if (legal == false)
+        {
+            continue;
+        }
+
+        relaid[i] = encodeInstruction(branch.opcode == 4 ? 15 : 4, branch.srcRegister, suffix + 1);
+        int n = fallThrough;
+        for (j = target; j < length; j++, n++)
+        {
+            relaid[n] = program[j];
+            relaidOrigin[n] = origin[j];
+            relaidFrom[n] = j;
+        }
+        relaid[n] = 0;
+        relaidOrigin[n] = -1;
+        relaidFrom[n++] = -1;
+        for (j = fallThrough; j < length; j++, n++)
+        {
+            relaid[n] = program[j];
+            relaidOrigin[n] = origin[j];
+            relaidFrom[n] = j;
+        }
+
+        // rewrite the MOVIs of every BR with the new address of its target, in the copy the BR itself lies in.
+        findLeaders(program, length, leader, shadowSlot);
+        for (n = 0; n < newLength && legal; n++)
+        {
+            int from = relaidFrom[n], highMovi, lowMovi;
+            if (from < 0 || decodeInstruction(program[from]).opcode != 7 ||
+                findBranchRegisterMovis(program, leader, from, &highMovi, &lowMovi) == false)
+            {
+                continue;
+            }
+            decodedInstruction high = decodeInstruction(program[highMovi]);
+            decodedInstruction low = decodeInstruction(program[lowMovi]);
+            int oldTarget = branchRegisterTarget(high.immediateVal, low.immediateVal);
+            int newTarget = oldTarget < fallThrough ? oldTarget
+                            : oldTarget > length    ? newLength + (oldTarget - length)
+                            : oldTarget >= target && n < fallThrough + suffix ? fallThrough + (oldTarget - target)
+                                                                               : fallThrough + suffix + 1 + (oldTarget - fallThrough);
+            if (newTarget == oldTarget)
+            {
+                continue;
+            }
+            legal = (newTarget >> 8) <= 31 && (newTarget & 0xFF) <= 31 &&
+                    (highMovi != lowMovi || (newTarget >> 8) == (newTarget & 0xFF));
+            relaid[n - (from - highMovi)] = encodeInstruction(3, high.srcRegister, newTarget >> 8);
+            relaid[n - (from - lowMovi)] = encodeInstruction(3, low.srcRegister, newTarget & 0xFF);
+        }
+        if (legal == false)
+        {
+            continue;
+        }
+
+        if (counted[origin[i]] == false)
+        {
+            // the branch no longer refills the pipeline when it is taken, but does when it falls through.
+            counted[origin[i]] = true;
+            savedCycles += (long long)penalty * (2 * takenExecutions[origin[i]] - executions[origin[i]]);
+        }
+        inverted++;
+        length = newLength;
+        memcpy(program, relaid, length * sizeof(short));
+        memcpy(origin, relaidOrigin, length * sizeof(int));
+    }
+
+    REPORT("Layout : inverted %d branches, %d instructions before, %d after, predicted %lld cycles on the profiled "
+           "input before, %lld after\n",
+           inverted, *programLength, length, profiledCycles, profiledCycles - savedCycles);
+    *programLength = length;
+}
+
+void layoutProgram(short *program, int *programLength, char *profilePath)
+{
+    static int executions[INSTRUCTION_MEMORY_SIZE];
+    static int takenExecutions[INSTRUCTION_MEMORY_SIZE];
+    int address, executed, taken;
+    long long profiledCycles = 0;
+    FILE *profile = fopen(profilePath, "r");
+
+    if (profile == NULL)
+    {
+        REPORT("Layout : error in opening profile file %s\n", profilePath);
+        return;
+    }
+    memset(executions, 0, sizeof(executions));
+    memset(takenExecutions, 0, sizeof(takenExecutions));
+    if (fscanf(profile, "cycles %lld", &profiledCycles) != 1)
+    {
+        REPORT("Layout : %s is not a profile written by --profile-out.\n", profilePath);
+        fclose(profile);
+        return;
+    }
+    while (fscanf(profile, "%d %d %d", &address, &executed, &taken) == 3)
+    {
+        if (address >= 0 && address < INSTRUCTION_MEMORY_SIZE)
+        {
+            executions[address] = executed;
+            takenExecutions[address] = taken;
+        }
+    }
+    fclose(profile);
+
+    layoutProgramWithCounts(program, programLength, executions, takenExecutions, profiledCycles);
+}
+
+/* Final state output. --output full prints all of the data memory and the registers, changed prints only the bytes
+    that differ from their initial value of 0 and the registers that are not 0, one per line (a byte stored with the
+    value it already held is not listed, only the bytes in the dirty bitmap have to be compared), and binary
+    writes the same sparse state to stdout as a registerDump, a 16 bit count and that many memoryChange records.
+    A multicore run prints the registers of every core after the shared memory : in changed mode each core's
+    registers follow a "Core N :" line, in binary mode a registerDump per core comes before the count.
+    checkExpectedState() compares the state with a file in the format of the changed output, every register and byte
+    it does not list being expected to hold 0. Like the changed output it only covers the general purpose registers and
+    the data memory, the status register and the PC are not compared. Registers listed before any "Core N :" line belong to core 0.
+*/
+
+typedef struct
+{
+    char registers[generalPuproseRegister];
+    char statusRegister;
+    char reserved;
+    int16_t PCRegister;
+} registerDump;
+
+typedef struct
+{
+    uint16_t address;
+    char value;
+    char reserved;
+} memoryChange;
+
+char *outputMode = "full";
+char *expectedStatePath = NULL;
+
+// returns the first address from address on that is marked in the dirty bitmap, DATA_MEMORY_SIZE when there is none.
+int nextDirtyByte(int address)
+{
+    while (address < DATA_MEMORY_SIZE)
+    {
+        uint64_t bits = coreDataMem->dirty[address / 64] >> (address % 64);
+        if (bits != 0)
+        {
+            return address + __builtin_ctzll(bits);
+        }
+        address = (address / 64 + 1) * 64;
+    }
+    return DATA_MEMORY_SIZE;
+}
+
+// returns the first address from address on whose byte was written and no longer holds 0, DATA_MEMORY_SIZE when none.
+int nextChangedByte(int address)
+{
+    for (address = nextDirtyByte(address); address < DATA_MEMORY_SIZE; address = nextDirtyByte(address + 1))
+    {
+        if (coreDataMem->dataMemory[address] != 0)
+        {
+            break;
+        }
+    }
+    return address;
+}
+
+void writeRegisterDump(registerFile *registers)
+{
+    registerDump dump;
+
+    memcpy(dump.registers, registers->generalRegisterFile, sizeof(dump.registers));
+    dump.statusRegister = registers->statusRegister;
+    dump.reserved = 0;
+    dump.PCRegister = registers->PCRegister;
+    fwrite(&dump, sizeof(dump), 1, stdout);
+}
+
+void writeMemoryChanges()
+{
+    uint16_t changedBytes = 0;
+    int address;
+
+    for (address = nextChangedByte(0); address < DATA_MEMORY_SIZE; address = nextChangedByte(address + 1))
+    {
+        changedBytes++;
+    }
+
+    fwrite(&changedBytes, sizeof(changedBytes), 1, stdout);
+    for (address = nextChangedByte(0); address < DATA_MEMORY_SIZE; address = nextChangedByte(address + 1))
+    {
+        memoryChange change = {address, coreDataMem->dataMemory[address], 0};
+        fwrite(&change, sizeof(change), 1, stdout);
+    }
+}
+
+void printChangedMemory()
+{
+    for (int address = nextChangedByte(0); address < DATA_MEMORY_SIZE; address = nextChangedByte(address + 1))
+    {
+        printf("M[%d] : %d\n", address, coreDataMem->dataMemory[address]);
+    }
+}
+
+void printChangedRegisters(registerFile *registers)
+{
+    for (int j = 0; j < generalPuproseRegister; j++)
+    {
+        if (registers->generalRegisterFile[j] != 0)
+        {
+            printf("R%d : %d\n", j, registers->generalRegisterFile[j]);
+        }
+    }
+}
+
+// print the memory and registers after full execution.
+void printMachineState()
+{
+    if (strcmp(outputMode, "binary") == 0)
+    {
+        writeRegisterDump(&regFile);
+        writeMemoryChanges();
+    }
+    else if (clockCycle > 1 && strcmp(outputMode, "changed") == 0)
+    {
+        printf("Program executed successfully -----------------------------------\n");
+        printChangedMemory();
+        printChangedRegisters(&regFile);
+    }
+    else if (clockCycle > 1)
+    {
+        printf("Program executed successfully -----------------------------------\n");
+        int j;
+        for (j = 0; j < DATA_MEMORY_SIZE; j++)
+        {
+            printf("%d ", coreDataMem->dataMemory[j]);
+        }
+
+        printf("\n");
+
+        for (j = 0; j < generalPuproseRegister; j++)
+        {
+            printf("R%d : %d ", j, regFile.generalRegisterFile[j]);
+        }
+    }
+    else
+    {
+        printf("No instructions to execute");
+    }
+}
+
+// compares the data memory and the register files of coreCount cores with the expected state.
+bool checkExpectedState(char *expectedPath, registerFile *registers, int coreCount)
+{
+    static char expectedRegisters[MAX_CORES][generalPuproseRegister];
+    char expectedMemory[DATA_MEMORY_SIZE] = {0};
+    char line[256];
+    int index, value, core = 0, mismatches = 0;
+    FILE *file = fopen(expectedPath, "r");
+
+    if (file == NULL)
+    {
+        REPORT("\nError in opening expected state file %s\n", expectedPath);
+        return false;
+    }
+    memset(expectedRegisters, 0, sizeof(expectedRegisters));
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (sscanf(line, "Core %d :", &index) == 1 && index >= 0 && index < MAX_CORES)
+        {
+            core = index;
+        }
+        else if (sscanf(line, "R%d : %d", &index, &value) == 2 && index >= 0 && index < generalPuproseRegister)
+        {
+            expectedRegisters[core][index] = value;
+        }
+        else if (sscanf(line, "M[%d] : %d", &index, &value) == 2 && index >= 0 && index < DATA_MEMORY_SIZE)
+        {
+            expectedMemory[index] = value;
+        }
+    }
+    fclose(file);
+
+    REPORT("\n");
+    for (index = 0; index < DATA_MEMORY_SIZE; index++)
+    {
+        if (coreDataMem->dataMemory[index] != expectedMemory[index])
+        {
+            REPORT("Mismatch M[%d] : expected %d, found %d\n", index, expectedMemory[index], coreDataMem->dataMemory[index]);
+            mismatches++;
+        }
+    }
+    for (core = 0; core < coreCount; core++)
+    {
+        for (index = 0; index < generalPuproseRegister; index++)
+        {
+            if (registers[core].generalRegisterFile[index] != expectedRegisters[core][index])
+            {
+                if (coreCount > 1)
+                {
+                    REPORT("Mismatch core %d R%d : expected %d, found %d\n", core, index, expectedRegisters[core][index],
+                           registers[core].generalRegisterFile[index]);
+                }
+                else
+                {
+                    REPORT("Mismatch R%d : expected %d, found %d\n", index, expectedRegisters[core][index],
+                           registers[core].generalRegisterFile[index]);
+                }
+                mismatches++;
+            }
+        }
+    }
+    REPORT("Expected state %s : %d mismatches\n", mismatches == 0 ? "matched" : "failed", mismatches);
+    return mismatches == 0;
+}
+
+/* runProgram() method, it's called to initalize the pipeline queues effectively, and run the program by moving through
+    the pipeline, until there are no more instructions left.
+*/
+void runProgram()
+{
+    bool flag = true;
+    initializeToBeDecodedQueue(&toBeDecodedq);
+    initializeToBeExecutedQueue(&toBeExecutedq);
+    TRACE("Running Program,instructions not in the pipeline are labeled Instruction (stage): 0 \n");
+
+    beginHostPhase();
+    while (flag == true)
+    {
+        flag = moveThroughPipeline(clockCycle);
+        clockCycle++;
+    }
+    endHostPhase(PHASE_PIPELINE);
+
+    beginHostPhase();
+    printMachineState();
+    endHostPhase(PHASE_OUTPUT);
+}
+
+/* Basic block memoisation. runMemoized() runs the program a basic block at a time, a block being the instructions
+    from a start PC up to and including the first branch. Given the same live-in registers, status register and
+    memory bytes read, a block always has the same effect, so the effect is kept in a cache of memoEntry and replayed
+    on a hit instead of executing the instructions again.
+    The live-in registers of a block are known from getInstructionEffects(); the memory bytes it reads are recorded
+    while it executes, register indirect accesses included, and compared on every hit. The cache holds at most
+    memoCacheEntries blocks and evicts the least recently used one. Blocks accessing more than MEMO_MAX_ACCESSES bytes
+    are always executed.
+*/
+
+typedef struct memoEntry
+{
+    short startPC;
+    short nextPC;
+    char statusIn;
+    char statusOut;
+    char registersIn[generalPuproseRegister];
+    char registersOut[generalPuproseRegister];
+    short readAddresses[MEMO_MAX_ACCESSES];
+    char readValues[MEMO_MAX_ACCESSES];
+    short writeAddresses[MEMO_MAX_ACCESSES];
+    char writeValues[MEMO_MAX_ACCESSES];
+    int reads;
+    int writes;
+    int instructions;
+    short branchAddress;
+    bool branchTaken;
+    bool flushed;
+    uint32_t hash;
+    struct memoEntry *nextInBucket;
+    struct memoEntry *newer;
+    struct memoEntry *older;
+} memoEntry;
+
+int memoCacheEntries = 0;
+memoEntry *memoEntries;
+memoEntry **memoBuckets;
+int memoBucketCount;
+int memoUsedEntries;
+memoEntry *memoNewest;
+memoEntry *memoOldest;
+uint64_t blockLiveIn[INSTRUCTION_MEMORY_SIZE];
+uint64_t blockLiveOut[INSTRUCTION_MEMORY_SIZE];
+bool blockScanned[INSTRUCTION_MEMORY_SIZE];
+long long memoHits, memoMisses, memoEvictions, memoUncached, memoFlushes;
+
+// the registers a block reads before writing them, and the registers it writes.
+void scanBlock(int startPC)
+{
+    uint64_t liveIn = 0, written = 0;
+
+    for (int pc = startPC; pc < INSTRUCTION_MEMORY_SIZE && instMemory.instructionMemory[pc] != 0; pc++)
+    {
+        instructionEffects effects = getInstructionEffects(instMemory.instructionMemory[pc]);
+        liveIn |= effects.registersRead & ~written;
+        written |= effects.registersWritten;
+        if (effects.isBranch)
+        {
+            break;
+        }
+    }
+    blockLiveIn[startPC] = liveIn;
+    blockLiveOut[startPC] = written;
+    blockScanned[startPC] = true;
+}
+
+uint32_t hashBlockInputs(int startPC)
+{
+    uint32_t hash = 2166136261u;
+
+    hash = (hash ^ (uint32_t)startPC) * 16777619u;
+    hash = (hash ^ (unsigned char)regFile.statusRegister) * 16777619u;
+    for (int r = 0; r < generalPuproseRegister; r++)
+    {
+        if (blockLiveIn[startPC] & (1ULL << r))
+        {
+            hash = (hash ^ (unsigned char)regFile.generalRegisterFile[r]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+void memoUnlink(memoEntry *entry)
+{
+    if (entry->newer != NULL)
+    {
+        entry->newer->older = entry->older;
+    }
+    else
+    {
+        memoNewest = entry->older;
+    }
+    if (entry->older != NULL)
+    {
+        entry->older->newer = entry->newer;
+    }
+    else
+    {
+        memoOldest = entry->newer;
+    }
+}
+
+void memoMakeNewest(memoEntry *entry)
+{
+    entry->older = memoNewest;
+    entry->newer = NULL;
+    if (memoNewest != NULL)
+    {
+        memoNewest->newer = entry;
+    }
+    memoNewest = entry;
+    if (memoOldest == NULL)
+    {
+        memoOldest = entry;
+    }
+}
+
+memoEntry *memoLookup(int startPC, uint32_t hash)
+{
+    for (memoEntry *entry = memoBuckets[hash & (memoBucketCount - 1)]; entry != NULL; entry = entry->nextInBucket)
+    {
+        bool match = entry->hash == hash && entry->startPC == startPC && entry->statusIn == regFile.statusRegister;
+        for (int r = 0; r < generalPuproseRegister && match; r++)
+        {
+            match = (blockLiveIn[startPC] & (1ULL << r)) == 0 ||
+                    entry->registersIn[r] == regFile.generalRegisterFile[r];
+        }
+        for (int k = 0; k < entry->reads && match; k++)
+        {
+            match = coreDataMem->dataMemory[entry->readAddresses[k]] == entry->readValues[k];
+        }
+        if (match)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// takes a free entry, or evicts the least recently used one out of its bucket.
+memoEntry *memoAllocate()
+{
+    memoEntry *entry;
+
+    if (memoUsedEntries < memoCacheEntries)
+    {
+        return &memoEntries[memoUsedEntries++];
+    }
+    entry = memoOldest;
+    memoUnlink(entry);
+    memoEntry **link = &memoBuckets[entry->hash & (memoBucketCount - 1)];
+    while (*link != entry)
+    {
+        link = &(*link)->nextInBucket;
+    }
+    *link = entry->nextInBucket;
+    memoEvictions++;
+    return entry;
+}
+
+void memoApply(memoEntry *entry)
+{
+    for (int r = 0; r < generalPuproseRegister; r++)
+    {
+        if (blockLiveOut[entry->startPC] & (1ULL << r))
+        {
+            regFile.generalRegisterFile[r] = entry->registersOut[r];
+        }
+    }
+    for (int k = 0; k < entry->writes; k++)
+    {
+        coreDataMem->dataMemory[entry->writeAddresses[k]] = entry->writeValues[k];
+        markDirty(entry->writeAddresses[k], 1);
+    }
+    regFile.statusRegister = entry->statusOut;
+    regFile.PCRegister = entry->nextPC;
+    instructionsExecuted += entry->instructions;
+    if (entry->branchAddress >= 0)
+    {
+        branchExecutions[entry->branchAddress]++;
+        branchTakenExecutions[entry->branchAddress] += entry->branchTaken;
+    }
+}
+
+// adds the data memory bytes instruction accesses to the list, at their address before it executes.
+int addMemoryAccesses(short *addresses, int count, int address, int bytes)
+{
+    for (int b = 0; b < bytes && count <= MEMO_MAX_ACCESSES; b++)
+    {
+        int byteAddress = (address + b) % DATA_MEMORY_SIZE;
+        bool seen = false;
+        for (int k = 0; k < count && seen == false; k++)
+        {
+            seen = addresses[k] == byteAddress;
+        }
+        if (seen == false)
+        {
+            if (count < MEMO_MAX_ACCESSES)
+            {
+                addresses[count] = byteAddress;
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+// executes the block at the PC one instruction at a time and records its inputs and effects into entry.
+void executeBlock(memoEntry *entry)
+{
+    int startPC = regFile.PCRegister;
+    int pc = startPC;
+
+    entry->startPC = startPC;
+    entry->statusIn = regFile.statusRegister;
+    memcpy(entry->registersIn, regFile.generalRegisterFile, sizeof(entry->registersIn));
+    entry->reads = 0;
+    entry->writes = 0;
+    entry->instructions = 0;
+    entry->branchAddress = -1;
+    entry->branchTaken = false;
+    entry->flushed = false;
+
+    while (pc >= 0 && pc < INSTRUCTION_MEMORY_SIZE && instMemory.instructionMemory[pc] != 0)
+    {
+        short instruction = instMemory.instructionMemory[pc];
+        decodedInstruction decodedInst = decodeInstruction(instruction);
+        instructionEffects effects = getInstructionEffects(instruction);
+        int field = decodedInst.immediateVal & 0b111111;
+        int pointerRegister = FIRST_POINTER_REGISTER + ((field >> 3) & 0b1) * 2;
+        int address = (((unsigned char)regFile.generalRegisterFile[pointerRegister] << 8) |
+                       (unsigned char)regFile.generalRegisterFile[pointerRegister + 1]) % DATA_MEMORY_SIZE;
+        int indirectBytes = (field >> 5) ? (field & 0b111) + 1 : 1;
+        int indirectAddress = (field >> 5) ? address : (address + (field & 0b111)) % DATA_MEMORY_SIZE;
+
+        if (effects.memoryRead != -1)
+        {
+            // a byte written earlier in the block is not an input of the block.
+            short readAddresses[MEMO_MAX_ACCESSES];
+            int reads = effects.memoryRead == UNKNOWN_ADDRESS
+                            ? addMemoryAccesses(readAddresses, 0, indirectAddress, indirectBytes)
+                            : addMemoryAccesses(readAddresses, 0, effects.memoryRead, effects.memoryBytes);
+            for (int k = 0; k < reads && k < MEMO_MAX_ACCESSES; k++)
+            {
+                bool written = false;
+                for (int w = 0; w < entry->writes && w < MEMO_MAX_ACCESSES && written == false; w++)
+                {
+                    written = entry->writeAddresses[w] == readAddresses[k];
+                }
+                if (written == false)
+                {
+                    int before = entry->reads;
+                    entry->reads = addMemoryAccesses(entry->readAddresses, entry->reads, readAddresses[k], 1);
+                    if (entry->reads > before && entry->reads <= MEMO_MAX_ACCESSES)
+                    {
+                        entry->readValues[before] = coreDataMem->dataMemory[readAddresses[k]];
+                    }
+                }
+            }
+        }
+        if (effects.memoryWritten != -1)
+        {
+            entry->writes = effects.memoryWritten == UNKNOWN_ADDRESS
+                                ? addMemoryAccesses(entry->writeAddresses, entry->writes, indirectAddress, indirectBytes)
+                                : addMemoryAccesses(entry->writeAddresses, entry->writes, effects.memoryWritten,
+                                                    effects.memoryBytes);
+        }
+
+        // executeInstruction() finds the address of a branch in the fetched address list, as in the pipeline.
+        fetchedAddresses[0] = pc;
+        fetchedAddressCount = 1;
+        regFile.PCRegister = pc + 1;
+        executeInstruction(decodedInst);
+        entry->instructions++;
+
+        if (effects.isBranch)
+        {
+            // a branch leaves its register unchanged, so the direction it took can be read back from it.
+            char srcRegVal = regFile.generalRegisterFile[decodedInst.srcRegister];
+            bool taken = decodedInst.opcode == 7 || (decodedInst.opcode == 4 ? srcRegVal == 0 : srcRegVal != 0);
+            entry->flushed = taken || skipBranchShadows == false;
+            if (decodedInst.opcode != 7)
+            {
+                entry->branchAddress = pc;
+                entry->branchTaken = taken;
+            }
+            if (taken == false)
+            {
+                regFile.PCRegister = pc + BRANCH_FALL_THROUGH;
+            }
+            break;
+        }
+        pc = regFile.PCRegister;
+    }
+
+    entry->nextPC = regFile.PCRegister;
+    entry->statusOut = regFile.statusRegister;
+    memcpy(entry->registersOut, regFile.generalRegisterFile, sizeof(entry->registersOut));
+    for (int k = 0; k < entry->writes && k < MEMO_MAX_ACCESSES; k++)
+    {
+        entry->writeValues[k] = coreDataMem->dataMemory[entry->writeAddresses[k]];
+    }
+}
+
+void executeMemoized()
+{
+    memoEntry scratch;
+
+    memoEntries = malloc(sizeof(memoEntry) * memoCacheEntries);
+    for (memoBucketCount = 1; memoBucketCount < memoCacheEntries * 2; memoBucketCount *= 2)
+    {
+    }
+    memoBuckets = calloc(memoBucketCount, sizeof(memoEntry *));
+    if (memoEntries == NULL || memoBuckets == NULL)
+    {
+        REPORT("Memo cache : cannot allocate %d entries.\n", memoCacheEntries);
+        exit(1);
+    }
+    memset(blockScanned, 0, sizeof(blockScanned));
+    memoUsedEntries = 0;
+    memoNewest = memoOldest = NULL;
+    memoHits = memoMisses = memoEvictions = memoUncached = memoFlushes = 0;
+
+    while (regFile.PCRegister >= 0 && regFile.PCRegister < INSTRUCTION_MEMORY_SIZE &&
+           instMemory.instructionMemory[regFile.PCRegister] != 0)
+    {
+        int startPC = regFile.PCRegister;
+        if (blockScanned[startPC] == false)
+        {
+            scanBlock(startPC);
+        }
+
+        uint32_t hash = hashBlockInputs(startPC);
+        memoEntry *entry = memoLookup(startPC, hash);
+        if (entry != NULL)
+        {
+            memoHits++;
+            memoUnlink(entry);
+            memoMakeNewest(entry);
+            memoApply(entry);
+        }
+        else
+        {
+            memoMisses++;
+            executeBlock(&scratch);
+            entry = &scratch;
+            if (scratch.reads > MEMO_MAX_ACCESSES || scratch.writes > MEMO_MAX_ACCESSES)
+            {
+                memoUncached++;
+            }
+            else
+            {
+                entry = memoAllocate();
+                *entry = scratch;
+                entry->hash = hash;
+                entry->nextInBucket = memoBuckets[hash & (memoBucketCount - 1)];
+                memoBuckets[hash & (memoBucketCount - 1)] = entry;
+                memoMakeNewest(entry);
+            }
+        }
+
+        // a taken branch only costs the refill when there is something left to fetch.
+        if (entry->flushed && regFile.PCRegister >= 0 && regFile.PCRegister < INSTRUCTION_MEMORY_SIZE &&
+            instMemory.instructionMemory[regFile.PCRegister] != 0)
+        {
+            memoFlushes++;
+        }
+    }
+
+    // the same clock as runProgram(), two cycles to fill the pipeline and one to find it empty, plus two lost after
+    // every taken branch.
+    if (instructionsExecuted > 0)
+    {
+        clockCycle = instructionsExecuted + 3 + memoFlushes * 2 + 1;
+    }
+    free(memoEntries);
+    free(memoBuckets);
+}
+
+void runMemoized()
+{
+    beginHostPhase();
+    executeMemoized();
+    endHostPhase(PHASE_PIPELINE);
+    beginHostPhase();
+    REPORT("Memo cache : %lld blocks, %lld hits, %lld misses (%.1f%% hit rate), %lld evictions, %lld blocks too large "
+           "to cache, %d of %d entries used, %lld instructions, %d cycles\n",
+           memoHits + memoMisses, memoHits, memoMisses,
+           memoHits + memoMisses > 0 ? 100.0 * memoHits / (memoHits + memoMisses) : 0.0, memoEvictions,
+           memoUncached, memoUsedEntries, memoCacheEntries, instructionsExecuted, clockCycle - 1);
+    printMachineState();
+    endHostPhase(PHASE_OUTPUT);
+}
+
+/* Multicore methods. runQuantum() moves the current core through at most quantum clock cycles, and returns false
+    once the core has no instructions left. saveCore() and restoreCore() move a core between its coreState and the
+    thread local state of the worker running it, runCoreWorker() is the body of every worker thread. The branch
+    counters are only used for the profile of a single core run, so they are not part of the saved state.
+*/
+
+double elapsedSeconds(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+bool runQuantum(int quantum)
+{
+    for (int q = 0; q < quantum; q++)
+    {
+        // counts the clock like runProgram(), including the cycle that finds the pipeline empty.
+        bool running = moveThroughPipeline();
+        clockCycle++;
+        if (running == false)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void saveCore(coreState *state)
+{
+    state->numOfInstruction = numOfInstruction;
+    state->clockCycle = clockCycle;
+    state->pipelineControl = pipelineControl;
+    state->instructionsExecuted = instructionsExecuted;
+    state->instructionsStage = instructionsStage;
+    state->regFile = regFile;
+    state->pipeline = pipeline;
+    state->toBeDecodedq = toBeDecodedq;
+    state->toBeExecutedq = toBeExecutedq;
+    memcpy(state->fetchedAddresses, fetchedAddresses, sizeof(fetchedAddresses));
+    state->fetchedAddressCount = fetchedAddressCount;
+    // the instruction memory is never written while a core runs, only the words of its program have to be kept.
+    memcpy(state->program, instMemory.instructionMemory, numOfInstruction * sizeof(short));
+}
+
+void restoreCore(const coreState *state)
+{
+    // clear the words of the previous core that lie past the end of this program, the rest is overwritten.
+    if (numOfInstruction > state->numOfInstruction)
+    {
+        memset(&instMemory.instructionMemory[state->numOfInstruction], 0,
+               (numOfInstruction - state->numOfInstruction) * sizeof(short));
+    }
+    memcpy(instMemory.instructionMemory, state->program, state->numOfInstruction * sizeof(short));
+
+    numOfInstruction = state->numOfInstruction;
+    clockCycle = state->clockCycle;
+    pipelineControl = state->pipelineControl;
+    instructionsExecuted = state->instructionsExecuted;
+    instructionsStage = state->instructionsStage;
+    regFile = state->regFile;
+    pipeline = state->pipeline;
+    toBeDecodedq = state->toBeDecodedq;
+    toBeExecutedq = state->toBeExecutedq;
+    memcpy(fetchedAddresses, state->fetchedAddresses, sizeof(fetchedAddresses));
+    fetchedAddressCount = state->fetchedAddressCount;
+}
+
+void *runCoreWorker(void *arg)
+{
+    int worker = (int)(intptr_t)arg;
+    struct timespec start;
+
+    // every round runs one quantum of each unfinished core of this worker, then waits for the other workers.
+    while (true)
+    {
+        for (int i = worker; i < numOfCores; i += coreWorkers)
+        {
+            coreContext *core = &cores[i];
+            if (core->finished)
+            {
+                continue;
+            }
+
+            restoreCore(&core->state);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            bool running = runQuantum(coreQuantum);
+            core->seconds += elapsedSeconds(start);
+            saveCore(&core->state);
+
+            if (running == false)
+            {
+                core->finished = true;
+                core->cycles = clockCycle - 1;
+                core->instructions = instructionsExecuted;
+                core->finalRegisters = regFile;
+                __atomic_fetch_sub(&runningCores, 1, __ATOMIC_RELAXED);
+            }
+        }
+
+        pthread_barrier_wait(&coreBarrier);
+        int remaining = __atomic_load_n(&runningCores, __ATOMIC_RELAXED);
+        pthread_barrier_wait(&coreBarrier);
+
+        if (remaining == 0)
+        {
+            break;
+        }
+    }
+    return NULL;
+}
+
+int hostProcessors()
+{
+#ifndef _WIN32
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    return processors > 0 ? (int)processors : 1;
+#else
+    return 1;
+#endif
+}
+
+/* runCoreWorkers() runs the cores saved in cores[0 .. numOfCores - 1] to the end on the pool of workers and returns the
+    wall clock seconds they took.
+*/
+double runCoreWorkers()
+{
+    pthread_t threads[MAX_CORES];
+    struct timespec start;
+    int i;
+
+    runningCores = numOfCores;
+    coreWorkers = deterministicCores ? 1 : hostProcessors();
+    if (coreWorkers > numOfCores)
+    {
+        coreWorkers = numOfCores;
+    }
+    pthread_barrier_init(&coreBarrier, NULL, coreWorkers);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (i = 0; i < coreWorkers; i++)
+    {
+        if (pthread_create(&threads[i], NULL, runCoreWorker, (void *)(intptr_t)i) != 0)
+        {
+            printf("Could not start worker thread %d.\n", i);
+            exit(1);
+        }
+    }
+
+    for (i = 0; i < coreWorkers; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    double seconds = elapsedSeconds(start);
+    pthread_barrier_destroy(&coreBarrier);
+    return seconds;
+}
+
+/* runCores() runs numOfCores cores sharing dataMem, core i runs programPaths[i % numOfPrograms]. When all cores are done
+    it prints the per-core and aggregate throughput counters, followed by the shared memory and every register file in
+    the --output format. It returns false when the state does not match the --expect file.
+*/
+bool runCores(char **programPaths, int numOfPrograms)
+{
+    static registerFile finalRegisters[MAX_CORES];
+    int i, j;
+
+    for (j = 0; j < DATA_MEMORY_SIZE; j++)
+    {
+        coreDataMem->dataMemory[j] = 0;
+    }
+    memset(coreDataMem->dirty, 0, sizeof(coreDataMem->dirty));
+
+    // assemble every core up front, the workers then only move cores between their state and the pipeline.
+    for (i = 0; i < numOfCores; i++)
+    {
+        cores[i].id = i;
+        cores[i].programPath = programPaths[i % numOfPrograms];
+        loadCoreProgram(cores[i].programPath);
+        initializeToBeDecodedQueue(&toBeDecodedq);
+        initializeToBeExecutedQueue(&toBeExecutedq);
+        saveCore(&cores[i].state);
+    }
+
+    double totalSeconds = runCoreWorkers();
+
+    long long totalCycles = 0, totalInstructions = 0;
+    REPORT("Cores executed successfully (%s, %d worker threads, quantum %d cycles) ---------------------------\n",
+           deterministicCores ? "deterministic" : "parallel", coreWorkers, coreQuantum);
+    for (i = 0; i < numOfCores; i++)
+    {
+        REPORT("Core %d (%s) : %lld cycles, %lld instructions, %.6f s, %.3f MIPS\n", i, cores[i].programPath,
+               cores[i].cycles, cores[i].instructions, cores[i].seconds,
+               cores[i].seconds > 0 ? cores[i].instructions / cores[i].seconds / 1e6 : 0.0);
+        totalCycles += cores[i].cycles;
+        totalInstructions += cores[i].instructions;
+    }
+    REPORT("All cores : %lld cycles, %lld instructions, %.6f s, %.3f MIPS\n", totalCycles, totalInstructions,
+           totalSeconds, totalSeconds > 0 ? totalInstructions / totalSeconds / 1e6 : 0.0);
+
+    for (i = 0; i < numOfCores; i++)
+    {
+        finalRegisters[i] = cores[i].finalRegisters;
+    }
+
+    if (strcmp(outputMode, "binary") == 0)
+    {
+        for (i = 0; i < numOfCores; i++)
+        {
+            writeRegisterDump(&finalRegisters[i]);
+        }
+        writeMemoryChanges();
+    }
+    else if (strcmp(outputMode, "changed") == 0)
+    {
+        printChangedMemory();
+        for (i = 0; i < numOfCores; i++)
+        {
+            printf("Core %d :\n", i);
+            printChangedRegisters(&finalRegisters[i]);
+        }
+    }
+    else
+    {
+        for (j = 0; j < DATA_MEMORY_SIZE; j++)
+        {
+            printf("%d ", coreDataMem->dataMemory[j]);
+        }
+        printf("\n");
+
+        for (i = 0; i < numOfCores; i++)
+        {
+            printf("Core %d : ", i);
+            for (j = 0; j < generalPuproseRegister; j++)
+            {
+                printf("R%d : %d ", j, finalRegisters[i].generalRegisterFile[j]);
+            }
+            printf("\n");
+        }
+    }
+
+    return expectedStatePath == NULL || checkExpectedState(expectedStatePath, finalRegisters, numOfCores);
+}
+
+/* loadImage() resets the current core and places the instruction words and the initial data memory image (every
+    missing byte being 0). runImage() loads them and runs the pipeline for at most cycleBudget clock cycles, it
+    returns false when the budget ran out. Only the state of the core and its data memory is reset, nothing is
+    parsed, so it can run many images quickly. Bytes outside the dirty bitmap are always 0, so only the dirty bytes
+    of the previous image are cleared.
+*/
+void loadImage(const short *words, int wordCount, const uint8_t *data, size_t dataBytes)
+{
+    resetCore();
+    memcpy(instMemory.instructionMemory, words, wordCount * sizeof(short));
+    numOfInstruction = wordCount;
+    for (int address = nextDirtyByte(0); address < DATA_MEMORY_SIZE; address = nextDirtyByte(address + 1))
+    {
+        coreDataMem->dataMemory[address] = 0;
+    }
+    memset(coreDataMem->dirty, 0, sizeof(coreDataMem->dirty));
+    memcpy(coreDataMem->dataMemory, data, dataBytes < DATA_MEMORY_SIZE ? dataBytes : DATA_MEMORY_SIZE);
+    for (size_t i = 0; i < dataBytes && i < DATA_MEMORY_SIZE; i++)
+    {
+        // the loaded image counts as written, the bitmap is private to this core so no atomics are needed.
+        coreDataMem->dirty[i / 64] |= 1ULL << (i % 64);
+    }
+}
+
+bool runImage(const short *words, int wordCount, const uint8_t *data, size_t dataBytes, long long cycleBudget)
+{
+    loadImage(words, wordCount, data, dataBytes);
+    initializeToBeDecodedQueue(&toBeDecodedq);
+    initializeToBeExecutedQueue(&toBeExecutedq);
+    previousCoveredAddress = 0;
+    previousCoveredOpcode = 0;
+    // counts the clock like runProgram(), including the cycle that finds the pipeline empty.
+    bool running = true;
+    while (running)
+    {
+        running = moveThroughPipeline();
+        clockCycle++;
+        if (running && clockCycle > cycleBudget)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Fuzzing harness. runFuzzInput() runs one raw input in the current core without any file or process per case:
+    byte 0 is the number of instruction words, followed by the words (high byte first) and the initial image of the
+    data memory. It runs them with runImage(), and a run stops after FUZZ_CYCLE_BUDGET clock cycles so endless BR loops
+    cannot hang the fuzzer.
+    Built with -DVCPU_LIBFUZZER, LLVMFuzzerTestOneInput() feeds it from libFuzzer instead of main(). Without it,
+    runFuzzer() is a small mutation fuzzer that keeps the inputs reaching new edges of coverageMap, and --fuzz-run
+    replays a single input file, for example a crash found by libFuzzer.
+*/
+bool runFuzzInput(const uint8_t *data, size_t size)
+{
+    short words[255];
+    size_t wordCount = size > 0 ? data[0] : 0;
+
+    if (wordCount > (size - (size > 0)) / 2)
+    {
+        wordCount = (size - (size > 0)) / 2;
+    }
+    for (size_t i = 0; i < wordCount; i++)
+    {
+        words[i] = (short)((data[1 + i * 2] << 8) | data[2 + i * 2]);
+    }
+
+    size_t dataStart = 1 + wordCount * 2;
+    return runImage(words, wordCount, data + dataStart, size > dataStart ? size - dataStart : 0, FUZZ_CYCLE_BUDGET);
+}
+
+uint64_t fuzzRandom(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// changes one to four bytes, instruction words or lengths of the input, returns the new size.
+size_t mutateFuzzInput(uint8_t *input, size_t size, uint8_t *other, size_t otherSize, uint64_t *state)
+{
+    int mutations = 1 + fuzzRandom(state) % 4;
+
+    for (int m = 0; m < mutations; m++)
+    {
+        size_t position = size > 0 ? fuzzRandom(state) % size : 0;
+        size_t word = 1 + 2 * (input[0] > 0 ? fuzzRandom(state) % input[0] : 0);
+        switch (fuzzRandom(state) % 6)
+        {
+        case 0:
+            input[position] ^= 1 << (fuzzRandom(state) % 8);
+            break;
+        case 1:
+            input[position] = fuzzRandom(state);
+            break;
+        case 2:
+            // a whole new instruction, any opcode, register and field.
+            if (word + 1 < size)
+            {
+                uint16_t instruction = fuzzRandom(state);
+                input[word] = instruction >> 8;
+                input[word + 1] = instruction & 0xFF;
+            }
+            break;
+        case 3:
+            input[0] = fuzzRandom(state) % 64;
+            break;
+        case 4:
+            // grow the input by random bytes, or cut it short.
+            if (fuzzRandom(state) % 2 && size + 16 <= FUZZ_MAX_INPUT)
+            {
+                for (int k = 0; k < 16; k++)
+                {
+                    input[size++] = fuzzRandom(state);
+                }
+            }
+            else if (size > 1)
+            {
+                size = 1 + fuzzRandom(state) % (size - 1);
+            }
+            break;
+        default:
+            // splice in the tail of another input of the corpus.
+            if (otherSize > position)
+            {
+                memcpy(input + position, other + position, otherSize - position);
+                size = otherSize;
+            }
+        }
+    }
+    return size;
+}
+
+void runFuzzer(long long iterations)
+{
+    static uint8_t corpus[FUZZ_CORPUS_SIZE][FUZZ_MAX_INPUT];
+    static size_t corpusSizes[FUZZ_CORPUS_SIZE];
+    static uint64_t coverage[FUZZ_MAP_SIZE / 8];
+    static uint64_t covered[FUZZ_MAP_SIZE / 8];
+    uint8_t input[FUZZ_MAX_INPUT];
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    int corpusCount = 1, edges = 0;
+    long long budgetExceeded = 0;
+    struct timespec start;
+
+    traceOutput = false;
+    coverageMap = (unsigned char *)coverage;
+    corpus[0][0] = 0;
+    corpusSizes[0] = 1;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (long long n = 0; n < iterations; n++)
+    {
+        int parent = fuzzRandom(&state) % corpusCount;
+        int other = fuzzRandom(&state) % corpusCount;
+        size_t size = corpusSizes[parent];
+        int newEdges = 0;
+
+        memcpy(input, corpus[parent], size);
+        size = mutateFuzzInput(input, size, corpus[other], corpusSizes[other], &state);
+
+        memset(coverage, 0, sizeof(coverage));
+        budgetExceeded += runFuzzInput(input, size) == false;
+        // the map is compared eight edges at a time, a new edge is a byte set in coverage but not in covered.
+        for (int i = 0; i < FUZZ_MAP_SIZE / 8; i++)
+        {
+            if (coverage[i] & ~covered[i])
+            {
+                newEdges += __builtin_popcountll(coverage[i] & ~covered[i]);
+                covered[i] |= coverage[i];
+            }
+        }
+
+        // keep the inputs that reached new edges, replacing a random one when the corpus is full.
+        if (newEdges > 0)
+        {
+            int slot = corpusCount < FUZZ_CORPUS_SIZE ? corpusCount++ : (int)(fuzzRandom(&state) % FUZZ_CORPUS_SIZE);
+            memcpy(corpus[slot], input, size);
+            corpusSizes[slot] = size;
+            edges += newEdges;
+        }
+    }
+
+    coverageMap = NULL;
+    double seconds = elapsedSeconds(start);
+    printf("Fuzzer : %lld executions in %.3f s (%.0f executions/s), %d edges covered, %d inputs in the corpus, "
+           "%lld inputs ran out of the %d cycle budget\n",
+           iterations, seconds, seconds > 0 ? iterations / seconds : 0.0, edges, corpusCount, budgetExceeded,
+           FUZZ_CYCLE_BUDGET);
+}
+
+void runFuzzFile(char *inputPath)
+{
+    static uint8_t input[FUZZ_MAX_INPUT];
+    FILE *file = fopen(inputPath, "rb");
+
+    if (file == NULL)
+    {
+        perror("File cannot be opened.");
+        exit(1);
+    }
+    size_t size = fread(input, 1, FUZZ_MAX_INPUT, file);
+    fclose(file);
+
+    if (runFuzzInput(input, size) == false)
+    {
+        printf("The input ran out of the %d cycle budget.\n", FUZZ_CYCLE_BUDGET);
+    }
+    printMachineState();
+}
+
+#ifndef _WIN32
+/* Simulation server. runServer() listens on a Unix domain socket and keeps a pool of worker threads, every worker
+    being a warm core with its own data memory. A client sends jobs back to back on its connection without waiting
+    for results, and every job is answered once a worker ran it, so results can arrive in another order than the jobs;
+    the id of the job tells them apart. All fields are in the native byte order of the host. A client that cannot
+    take a result any more is not served further, and SIGINT or SIGTERM stop the server and remove its socket.
+    A job is a jobHeader followed by instructionWords 16 bit instruction words and dataBytes bytes of initial data
+    memory. The result is a jobResultHeader, followed for detail 1 or more by a registerDump and for detail 2 by
+    changedBytes memoryChange records, the bytes of data memory that differ from the initial image. Only the bytes
+    in the dirty bitmap can differ.
+*/
+
+#define SERVER_QUEUE_SIZE 1024
+#define SERVER_DEFAULT_BUDGET 1000000
+
+typedef struct
+{
+    uint32_t id;
+    uint32_t cycleBudget; // 0 for SERVER_DEFAULT_BUDGET.
+    uint16_t instructionWords;
+    uint16_t dataBytes;
+    uint8_t detail;
+    uint8_t reserved[3];
+} jobHeader;
+
+typedef struct
+{
+    uint32_t id;
+    uint8_t finished; // 0 when the job ran out of its cycle budget.
+    uint8_t detail;
+    uint16_t changedBytes;
+    uint64_t cycles;
+    uint64_t instructions;
+} jobResultHeader;
 
-        for (j = 0; j < generalPuproseRegister; j++)
+typedef struct
+{
+    int socket;
+    int pendingJobs; // jobs not answered yet, plus one while the connection is still read.
+    bool broken;     // a result could not be written, the remaining jobs are not answered.
+    pthread_mutex_t writeLock;
+} serverConnection;
+
+typedef struct
+{
+    jobHeader header;
+    short words[INSTRUCTION_MEMORY_SIZE];
+    uint8_t data[DATA_MEMORY_SIZE];
+    serverConnection *connection;
+} serverJob;
+
+serverJob *jobQueue[SERVER_QUEUE_SIZE];
+int jobQueueFront = 0;
+int jobQueueCount = 0;
+pthread_mutex_t jobQueueLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t jobQueueNotEmpty = PTHREAD_COND_INITIALIZER;
+pthread_cond_t jobQueueNotFull = PTHREAD_COND_INITIALIZER;
+int serverListener = -1;
+char *serverPath;
+
+bool readFully(int socket, void *buffer, size_t size)
+{
+    char *bytes = buffer;
+    while (size > 0)
+    {
+        ssize_t n = read(socket, bytes, size);
+        if (n <= 0)
         {
-            printf("R%d : %d ", j, regFile.generalRegisterFile[j]);
+            return false;
+        }
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool writeFully(int socket, const void *buffer, size_t size)
+{
+    const char *bytes = buffer;
+    while (size > 0)
+    {
+        ssize_t n = write(socket, bytes, size);
+        if (n <= 0)
+        {
+            return false;
+        }
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
+
+// the connection is closed once it was read to the end and all of its jobs are answered.
+void releaseConnection(serverConnection *connection)
+{
+    pthread_mutex_lock(&connection->writeLock);
+    bool last = --connection->pendingJobs == 0;
+    pthread_mutex_unlock(&connection->writeLock);
+    if (last)
+    {
+        close(connection->socket);
+        pthread_mutex_destroy(&connection->writeLock);
+        free(connection);
+    }
+}
+
+void *serverReader(void *arg)
+{
+    serverConnection *connection = arg;
+    jobHeader header;
+
+    while (readFully(connection->socket, &header, sizeof(header)))
+    {
+        if (header.instructionWords > INSTRUCTION_MEMORY_SIZE || header.dataBytes > DATA_MEMORY_SIZE)
+        {
+            printf("Server : job %u has %u instruction words and %u data bytes, closing the connection.\n",
+                   header.id, header.instructionWords, header.dataBytes);
+            break;
+        }
+        serverJob *job = malloc(sizeof(serverJob));
+        if (job == NULL || readFully(connection->socket, job->words, header.instructionWords * sizeof(short)) == false ||
+            readFully(connection->socket, job->data, header.dataBytes) == false)
+        {
+            free(job);
+            break;
+        }
+        job->header = header;
+        job->connection = connection;
+
+        pthread_mutex_lock(&connection->writeLock);
+        connection->pendingJobs++;
+        pthread_mutex_unlock(&connection->writeLock);
+
+        pthread_mutex_lock(&jobQueueLock);
+        while (jobQueueCount == SERVER_QUEUE_SIZE)
+        {
+            pthread_cond_wait(&jobQueueNotFull, &jobQueueLock);
+        }
+        jobQueue[(jobQueueFront + jobQueueCount++) % SERVER_QUEUE_SIZE] = job;
+        pthread_cond_signal(&jobQueueNotEmpty);
+        pthread_mutex_unlock(&jobQueueLock);
+    }
+
+    releaseConnection(connection);
+    return NULL;
+}
+
+void *serverWorker(void *arg)
+{
+    static _Thread_local dataMemory workerDataMem;
+    static _Thread_local char result[sizeof(jobResultHeader) + sizeof(registerDump) + DATA_MEMORY_SIZE * sizeof(memoryChange)];
+    (void)arg;
+
+    coreDataMem = &workerDataMem;
+    while (true)
+    {
+        pthread_mutex_lock(&jobQueueLock);
+        while (jobQueueCount == 0)
+        {
+            pthread_cond_wait(&jobQueueNotEmpty, &jobQueueLock);
+        }
+        serverJob *job = jobQueue[jobQueueFront];
+        jobQueueFront = (jobQueueFront + 1) % SERVER_QUEUE_SIZE;
+        jobQueueCount--;
+        pthread_cond_signal(&jobQueueNotFull);
+        pthread_mutex_unlock(&jobQueueLock);
+
+        jobHeader *header = &job->header;
+        bool finished = runImage(job->words, header->instructionWords, job->data, header->dataBytes,
+                                 header->cycleBudget > 0 ? header->cycleBudget : SERVER_DEFAULT_BUDGET);
+
+        jobResultHeader resultHeader = {header->id, finished, header->detail, 0, clockCycle - 1, instructionsExecuted};
+        size_t size = sizeof(resultHeader);
+        if (header->detail >= 1)
+        {
+            registerDump registers;
+            memcpy(registers.registers, regFile.generalRegisterFile, sizeof(registers.registers));
+            registers.statusRegister = regFile.statusRegister;
+            registers.reserved = 0;
+            registers.PCRegister = regFile.PCRegister;
+            memcpy(result + size, &registers, sizeof(registers));
+            size += sizeof(registers);
+        }
+        if (header->detail >= 2)
+        {
+            for (int address = nextDirtyByte(0); address < DATA_MEMORY_SIZE; address = nextDirtyByte(address + 1))
+            {
+                char initial = address < header->dataBytes ? (char)job->data[address] : 0;
+                if (workerDataMem.dataMemory[address] != initial)
+                {
+                    memoryChange change = {address, workerDataMem.dataMemory[address], 0};
+                    memcpy(result + size, &change, sizeof(change));
+                    size += sizeof(change);
+                    resultHeader.changedBytes++;
+                }
+            }
+        }
+        memcpy(result, &resultHeader, sizeof(resultHeader));
+
+        pthread_mutex_lock(&job->connection->writeLock);
+        if (job->connection->broken == false && writeFully(job->connection->socket, result, size) == false)
+        {
+            // the client went away or stopped reading, shutting the socket down also ends its reader.
+            job->connection->broken = true;
+            shutdown(job->connection->socket, SHUT_RDWR);
+        }
+        pthread_mutex_unlock(&job->connection->writeLock);
+        releaseConnection(job->connection);
+        free(job);
+    }
+    return NULL;
+}
+
+// closes and removes the socket on SIGINT and SIGTERM, only async signal safe calls are used.
+void stopServer(int signalNumber)
+{
+    (void)signalNumber;
+    close(serverListener);
+    unlink(serverPath);
+    _exit(0);
+}
+
+void runServer(char *socketPath, int workers)
+{
+    struct sockaddr_un address;
+    pthread_t thread;
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (listener < 0 || strlen(socketPath) >= sizeof(address.sun_path))
+    {
+        printf("Server : cannot create a socket at %s\n", socketPath);
+        exit(1);
+    }
+    strcpy(address.sun_path, socketPath);
+    unlink(socketPath);
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 64) != 0)
+    {
+        perror("Server : cannot listen on the socket");
+        exit(1);
+    }
+
+    // a client that disconnects early must not kill the server while a worker writes its results.
+    serverListener = listener;
+    serverPath = socketPath;
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+    traceOutput = false;
+    for (int i = 0; i < workers; i++)
+    {
+        pthread_create(&thread, NULL, serverWorker, NULL);
+        pthread_detach(thread);
+    }
+    printf("Server : listening on %s with %d workers\n", socketPath, workers);
+    fflush(stdout);
+
+    while (true)
+    {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0)
+        {
+            continue;
+        }
+        serverConnection *connection = malloc(sizeof(serverConnection));
+        connection->socket = client;
+        connection->pendingJobs = 1;
+        connection->broken = false;
+        pthread_mutex_init(&connection->writeLock, NULL);
+        pthread_create(&thread, NULL, serverReader, connection);
+        pthread_detach(thread);
+    }
+}
+#endif
+
+/* Benchmarks. --bench RUNS generates representative programs as assembly text, assembles them with
+    convertToBinary() and runs every one RUNS times in every execution mode : the pipeline, the memo cache, the pipeline
+    after optimizeProgram(), after scheduleProgram() for classic5 (harvard has no latencies to hide) and after
+    layoutProgramWithCounts() from a profiled run, and --cores cores (BENCH_CORES when --cores is not given) running
+    the program on the pool of workers, their cycles and instructions being summed.
+    These are followed by micro-benchmarks of the assembler, decoder, executor and flag logic. Every result is one line of
+    key=value pairs, so runs can be compared by scripts:
+        bench workload=NAME mode=MODE runs=.. instructions=.. cycles=.. seconds=.. mips=.. ns_per_instruction=..
+              cycles_per_second=..
+        micro function=NAME calls=.. seconds=.. ns_per_call=..
+    The workloads only use forward BEQZ and BR for their loops, every BR target is below 32 and loaded by MOVIs in the
+    block of the BR, so findLeaders() resolves it and the passes can work on every workload.
+*/
+
+#define BENCH_MICRO_CALLS 100000
+#define BENCH_CORES 4
+
+char benchLines[INSTRUCTION_MEMORY_SIZE][32];
+int benchLineCount;
+volatile int benchSink;
+
+void benchLine(const char *format, int first, int second)
+{
+    snprintf(benchLines[benchLineCount++], sizeof(benchLines[0]), format, first, second);
+}
+
+// loop tail: counts R1 down with R4 = -1 and jumps back to loopStart through R2:R3 until R1 is 0, then leaves the
+// loop past the BR and the skipped instructions after it.
+void benchLoopTail(int loopStart, int skipped)
+{
+    benchLine("ADD R1, R4", 0, 0);
+    benchLine("BEQZ R1, %d", 3 + skipped, 0);
+    benchLine("MOVI R0, 0", 0, 0);
+    benchLine("MOVI R0, 0", 0, 0);
+    benchLine("MOVI R2, 0", 0, 0);
+    benchLine("MOVI R3, %d", loopStart, 0);
+    benchLine("BR R2, R3", 0, 0);
+}
+
+// loop head: R1 = 0 runs the loop 256 times, returns the address the loop starts at.
+int benchLoopHead()
+{
+    benchLine("MOVI R1, 0", 0, 0);
+    benchLine("MOVI R4, -1", 0, 0);
+    benchLine("MOVI R5, 1", 0, 0);
+    return benchLineCount;
+}
+
+void generateBenchProgram(char *workload)
+{
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    char *aluOperations[] = {"ADD R%d, R%d", "SUB R%d, R%d", "MUL R%d, R%d", "EOR R%d, R%d"};
+    char *immediateOperations[] = {"MOVI R%d, %d", "ANDI R%d, %d", "SAL R%d, %d", "SAR R%d, %d"};
+
+    benchLineCount = 0;
+    if (strcmp(workload, "alu") == 0)
+    {
+        // straight line ALU code over R1 - R15.
+        for (int i = 0; i < 1000; i++)
+        {
+            int dst = 1 + fuzzRandom(&state) % 15;
+            if (fuzzRandom(&state) % 3)
+            {
+                benchLine(aluOperations[fuzzRandom(&state) % 4], dst, 1 + fuzzRandom(&state) % 15);
+            }
+            else
+            {
+                benchLine(immediateOperations[fuzzRandom(&state) % 4], dst, fuzzRandom(&state) % 8);
+            }
+        }
+    }
+    else if (strcmp(workload, "loop") == 0)
+    {
+        // 16 times a tight loop of 256 iterations.
+        benchLine("MOVI R7, 16", 0, 0);
+        benchLine("MOVI R4, -1", 0, 0);
+        benchLine("MOVI R5, 1", 0, 0);
+        int outerStart = benchLineCount;
+        benchLine("MOVI R1, 0", 0, 0);
+        int innerStart = benchLineCount;
+        benchLine("ADD R6, R5", 0, 0);
+        benchLoopTail(innerStart, 0);
+        benchLine("ADD R7, R4", 0, 0);
+        benchLine("BEQZ R7, 3", 0, 0);
+        benchLine("MOVI R0, 0", 0, 0);
+        benchLine("MOVI R0, 0", 0, 0);
+        benchLine("MOVI R2, 0", 0, 0);
+        benchLine("MOVI R8, %d", outerStart, 0);
+        benchLine("BR R2, R8", 0, 0);
+        benchLine("STR R6, 0", 0, 0);
+    }
+    else if (strcmp(workload, "dispatch") == 0)
+    {
+        // every iteration dispatches on R1 & 3 to one of four cases, with a chain of BEQZ as a jump table would need a
+        // computed BR target. Case 3 falls through into the loop tail, cases 0 - 2 come after it and BR back to it.
+        int loopStart = benchLoopHead();
+        benchLine("MOVI R10, 0", 0, 0);
+        benchLine("ADD R10, R1", 0, 0);
+        benchLine("ANDI R10, 3", 0, 0);
+        int tailStart = benchLineCount + 3 * 4 + 3;
+        int caseStart = tailStart + 7;
+        for (int entry = 0; entry < 3; entry++)
+        {
+            benchLine("BEQZ R10, %d", caseStart + entry * 6 - (benchLineCount + 3), 0);
+            benchLine("MOVI R0, 0", 0, 0);
+            benchLine("MOVI R0, 0", 0, 0);
+            benchLine("ADD R10, R4", 0, 0);
+        }
+        for (int entry = 3; entry < 7; entry++)
+        {
+            if (entry == 4)
+            {
+                benchLoopTail(loopStart, 3 * 6);
+            }
+            benchLine("ADD R%d, R5", 20 + entry % 4, 0);
+            benchLine("EOR R6, R1", 0, 0);
+            benchLine("SUB R7, R5", 0, 0);
+            if (entry > 3)
+            {
+                benchLine("MOVI R2, 0", 0, 0);
+                benchLine("MOVI R12, %d", tailStart, 0);
+                benchLine("BR R2, R12", 0, 0);
+            }
+        }
+        benchLine("STR R20, 0", 0, 0);
+    }
+    else if (strcmp(workload, "stream") == 0)
+    {
+        // 256 times copies bytes 0 - 31 to 32 - 63, adding one on the way.
+        int loopStart = benchLoopHead();
+        for (int address = 0; address < 32; address++)
+        {
+            benchLine("LDR R20, %d", address, 0);
+            benchLine("ADD R20, R5", 0, 0);
+            benchLine("STR R20, %d", address + 32, 0);
         }
+        benchLoopTail(loopStart, 0);
     }
     else
     {
-        printf("No instructions to execute");
+        // a loop around random ALU, bit, vector and memory instructions and short forward branches over R16 - R47.
+        int loopStart = benchLoopHead();
+        // R60:R61 = 64, the register indirect accesses use bytes 64 - 71, past the ones of LDR and STR.
+        benchLine("MOVI R60, 0", 0, 0);
+        benchLine("MOVI R61, 16", 0, 0);
+        benchLine("SAL R61, 2", 0, 0);
+        for (int i = 0; i < 120; i++)
+        {
+            int reg = 16 + fuzzRandom(&state) % 32;
+            switch (fuzzRandom(&state) % 8)
+            {
+            case 0:
+                benchLine(aluOperations[fuzzRandom(&state) % 4], reg, 16 + fuzzRandom(&state) % 32);
+                break;
+            case 1:
+                benchLine(immediateOperations[fuzzRandom(&state) % 4], reg, fuzzRandom(&state) % 8);
+                break;
+            case 2:
+                benchLine(fuzzRandom(&state) % 2 ? "LDR R%d, %d" : "STR R%d, %d", reg, fuzzRandom(&state) % 64);
+                break;
+            case 3:
+                benchLine(fuzzRandom(&state) % 2 ? "POPCNT R%d" : "ROL R%d, %d", reg, fuzzRandom(&state) % 8);
+                break;
+            case 4:
+                benchLine(fuzzRandom(&state) % 2 ? "BFX R%d, R%d" : "CTZ R%d", reg, fuzzRandom(&state) % 6);
+                break;
+            case 5:
+                benchLine(fuzzRandom(&state) % 2 ? "VADD V%d, V%d" : "VXOR V%d, V%d", 2 + fuzzRandom(&state) % 4,
+                          2 + fuzzRandom(&state) % 4);
+                break;
+            case 6:
+                benchLine(fuzzRandom(&state) % 2 ? "LDRX R%d, R60, %d" : "STRX R%d, R60, %d", reg, fuzzRandom(&state) % 8);
+                break;
+            default:
+                benchLine(i < 110 ? "BEQZ R%d, %d" : "MOVI R%d, %d", reg, fuzzRandom(&state) % 4);
+            }
+        }
+        benchLoopTail(loopStart, 0);
+    }
+}
+
+int assembleBenchProgram(short *words)
+{
+    char line[32];
+
+    for (int i = 0; i < benchLineCount; i++)
+    {
+        strcpy(line, benchLines[i]);
+        words[i] = convertToBinary(line);
+    }
+    return benchLineCount;
+}
+
+void runBenchmarks(int runs)
+{
+    char *workloads[] = {"alu", "loop", "dispatch", "stream", "mixed"};
+    char *modes[] = {"pipeline", "memo", "optimize", "schedule", "layout", "multicore"};
+    short words[INSTRUCTION_MEMORY_SIZE];
+    short passWords[INSTRUCTION_MEMORY_SIZE];
+    struct timespec start;
+    double seconds;
+
+    // the reports of the passes go to stderr, stdout only holds the bench lines.
+    traceOutput = false;
+    reportToStderr = true;
+    if (numOfCores == 1)
+    {
+        numOfCores = BENCH_CORES;
+    }
+    if (memoCacheEntries <= 0)
+    {
+        memoCacheEntries = DEFAULT_MEMO_ENTRIES;
+    }
+
+    for (int w = 0; w < (int)(sizeof(workloads) / sizeof(workloads[0])); w++)
+    {
+        generateBenchProgram(workloads[w]);
+        int wordCount = assembleBenchProgram(words);
+
+        for (int m = 0; m < (int)(sizeof(modes) / sizeof(modes[0])); m++)
+        {
+            long long instructions = 0, cycles = 0;
+
+            // the passes run once, outside of the timed runs, as they do when a program is loaded.
+            int passCount = wordCount;
+            memcpy(passWords, words, wordCount * sizeof(short));
+            if (strcmp(modes[m], "optimize") == 0)
+            {
+                optimizeProgram(passWords, &passCount);
+            }
+            else if (strcmp(modes[m], "schedule") == 0)
+            {
+                scheduleProgram(passWords, passCount, "classic5");
+            }
+            else if (strcmp(modes[m], "layout") == 0)
+            {
+                // the profile is one run of the program, as --profile-out writes it.
+                runImage(passWords, passCount, NULL, 0, FUZZ_CYCLE_BUDGET * 1000LL);
+                layoutProgramWithCounts(passWords, &passCount, branchExecutions, branchTakenExecutions, clockCycle - 1);
+                skipBranchShadows = true;
+            }
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (int run = 0; run < runs; run++)
+            {
+                if (strcmp(modes[m], "memo") == 0)
+                {
+                    loadImage(words, wordCount, NULL, 0);
+                    executeMemoized();
+                    instructions += instructionsExecuted;
+                    cycles += clockCycle - 1;
+                }
+                else if (strcmp(modes[m], "multicore") == 0)
+                {
+                    for (int i = 0; i < numOfCores; i++)
+                    {
+                        loadImage(words, wordCount, NULL, 0);
+                        initializeToBeDecodedQueue(&toBeDecodedq);
+                        initializeToBeExecutedQueue(&toBeExecutedq);
+                        cores[i].finished = false;
+                        cores[i].seconds = 0;
+                        saveCore(&cores[i].state);
+                    }
+                    runCoreWorkers();
+                    for (int i = 0; i < numOfCores; i++)
+                    {
+                        instructions += cores[i].instructions;
+                        cycles += cores[i].cycles;
+                    }
+                }
+                else
+                {
+                    runImage(passWords, passCount, NULL, 0, FUZZ_CYCLE_BUDGET * 1000LL);
+                    instructions += instructionsExecuted;
+                    cycles += clockCycle - 1;
+                }
+            }
+            seconds = elapsedSeconds(start);
+            skipBranchShadows = false;
+            printf("bench workload=%s mode=%s runs=%d instructions=%lld cycles=%lld seconds=%.6f mips=%.3f "
+                   "ns_per_instruction=%.3f cycles_per_second=%.0f\n",
+                   workloads[w], modes[m], runs, instructions, cycles, seconds, instructions / seconds / 1e6,
+                   seconds * 1e9 / instructions, cycles / seconds);
+        }
+    }
+
+    // component micro-benchmarks, on the lines and words of the mixed workload.
+    long long calls = (long long)runs * BENCH_MICRO_CALLS;
+    int wordCount = assembleBenchProgram(words);
+    char line[32];
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long long n = 0; n < calls / 100; n++)
+    {
+        strcpy(line, benchLines[n % benchLineCount]);
+        benchSink += convertToBinary(line);
+    }
+    seconds = elapsedSeconds(start);
+    printf("micro function=convertToBinary calls=%lld seconds=%.6f ns_per_call=%.3f\n", calls / 100, seconds,
+           seconds * 1e9 / (calls / 100));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long long n = 0; n < calls; n++)
+    {
+        benchSink += decodeInstruction(words[n % wordCount]).immediateVal;
     }
+    seconds = elapsedSeconds(start);
+    printf("micro function=decodeInstruction calls=%lld seconds=%.6f ns_per_call=%.3f\n", calls, seconds,
+           seconds * 1e9 / calls);
+
+    // executes the straight line ALU workload instruction by instruction, outside of the pipeline.
+    generateBenchProgram("alu");
+    wordCount = assembleBenchProgram(words);
+    loadImage(words, wordCount, NULL, 0);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long long n = 0; n < calls; n++)
+    {
+        decodedInstruction decodedInst = decodeInstruction(words[n % wordCount]);
+        fetchedAddresses[0] = n % wordCount;
+        fetchedAddressCount = 1;
+        executeInstruction(decodedInst);
+    }
+    seconds = elapsedSeconds(start);
+    printf("micro function=executeInstruction calls=%lld seconds=%.6f ns_per_call=%.3f\n", calls, seconds,
+           seconds * 1e9 / calls);
+
+    decodedInstruction add = decodeInstruction(words[0] & 0x0FFF);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long long n = 0; n < calls; n++)
+    {
+        updateStatusRegister((char)n, (char)(n >> 8), (char)(n + (n >> 8)), add);
+    }
+    benchSink += regFile.statusRegister;
+    seconds = elapsedSeconds(start);
+    printf("micro function=updateStatusRegister calls=%lld seconds=%.6f ns_per_call=%.3f\n", calls, seconds,
+           seconds * 1e9 / calls);
 }
 
-int main()
+#ifdef VCPU_LIBFUZZER
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    traceOutput = false;
+    runFuzzInput(data, size);
+    return 0;
+}
+#else
+/* main() usage : main.exe [--quiet] [--optimize] [--schedule PIPELINE] [--profile-out FILE] [--profile-in FILE]
+        [--memo ENTRIES] [--fuzz ITERATIONS] [--fuzz-run INPUT] [--bench RUNS] [--serve SOCKET] [--output full|changed|binary]
+        [--expect FILE] [--counters] [--cores N] [--quantum CYCLES] [--deterministic] [program files...]
+    Without program files instructions.txt is used. --profile-in lays the program out from a profile and fetches past the shadows of conditional branches. --counters measures a single core run with host hardware counters and is rejected in the other modes. With more than one core, core i runs the (i mod count)th file.
+*/
+int main(int argc, char *argv[])
 {
-    loadProgram("instructions.txt");
-    runProgram();
+    char *programPaths[MAX_CORES];
+    int numOfPrograms = 0;
+    long long fuzzIterations = 0;
+    char *fuzzInputPath = NULL;
+    char *serverSocketPath = NULL;
+    int benchmarkRuns = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--quiet") == 0)
+        {
+            traceOutput = false;
+        }
+        else if (strcmp(argv[i], "--cores") == 0 && i + 1 < argc)
+        {
+            numOfCores = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--quantum") == 0 && i + 1 < argc)
+        {
+            coreQuantum = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--deterministic") == 0)
+        {
+            deterministicCores = true;
+        }
+        else if (strcmp(argv[i], "--counters") == 0)
+        {
+            hostCountersEnabled = true;
+        }
+        else if (strcmp(argv[i], "--optimize") == 0)
+        {
+            optimizeAssembly = true;
+        }
+        else if (strcmp(argv[i], "--schedule") == 0 && i + 1 < argc)
+        {
+            schedulePipeline = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile-out") == 0 && i + 1 < argc)
+        {
+            profileOutputPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile-in") == 0 && i + 1 < argc)
+        {
+            profileInputPath = argv[++i];
+            skipBranchShadows = true;
+        }
+        else if (strcmp(argv[i], "--memo") == 0 && i + 1 < argc)
+        {
+            memoCacheEntries = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--fuzz") == 0 && i + 1 < argc)
+        {
+            fuzzIterations = atoll(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--fuzz-run") == 0 && i + 1 < argc)
+        {
+            fuzzInputPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            outputMode = argv[++i];
+        }
+        else if (strcmp(argv[i], "--expect") == 0 && i + 1 < argc)
+        {
+            expectedStatePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+        {
+            benchmarkRuns = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+        {
+            serverSocketPath = argv[++i];
+        }
+        else if (numOfPrograms < MAX_CORES)
+        {
+            programPaths[numOfPrograms++] = argv[i];
+        }
+    }
+
+    if (numOfCores < 1 || numOfCores > MAX_CORES || coreQuantum < 1)
+    {
+        printf("The number of cores must be between 1 and %d, and the quantum at least 1 cycle.\n", MAX_CORES);
+        return 1;
+    }
+    if (hostCountersEnabled && (numOfCores > 1 || serverSocketPath != NULL || benchmarkRuns > 0 || fuzzIterations > 0 ||
+                                fuzzInputPath != NULL))
+    {
+        // the counters and their phases are shared by the whole process, they only measure a single core run.
+        printf("--counters cannot be combined with --cores, --serve, --bench, --fuzz or --fuzz-run.\n");
+        return 1;
+    }
+    if (strcmp(outputMode, "full") != 0 && strcmp(outputMode, "changed") != 0 && strcmp(outputMode, "binary") != 0)
+    {
+        printf("The output format must be full, changed or binary.\n");
+        return 1;
+    }
+    if (strcmp(outputMode, "binary") == 0)
+    {
+        // stdout only carries the binary state, the trace is off and the reports go to stderr.
+        traceOutput = false;
+        reportToStderr = true;
+    }
+
+    if (serverSocketPath != NULL)
+    {
+#ifndef _WIN32
+        // every worker of the server is a core, --cores sets the size of the pool.
+        runServer(serverSocketPath, numOfCores);
+#else
+        printf("The server needs Unix domain sockets.\n");
+#endif
+        return 0;
+    }
+    if (benchmarkRuns > 0)
+    {
+        runBenchmarks(benchmarkRuns);
+        return 0;
+    }
+    if (fuzzIterations > 0)
+    {
+        runFuzzer(fuzzIterations);
+        return 0;
+    }
+    if (fuzzInputPath != NULL)
+    {
+        runFuzzFile(fuzzInputPath);
+        return 0;
+    }
+
+    if (numOfPrograms == 0)
+    {
+        programPaths[numOfPrograms++] = "instructions.txt";
+    }
+
+    if (numOfCores > 1)
+    {
+        // interleaved traces of several cores are unreadable, only the counters and final state are printed.
+        traceOutput = false;
+        return runCores(programPaths, numOfPrograms) ? 0 : 1;
+    }
+
+    if (memoCacheEntries > 0)
+    {
+        // the cache replays whole blocks, there is no per instruction trace to print.
+        traceOutput = false;
+    }
+
+    if (hostCountersEnabled)
+    {
+        openHostCounters();
+    }
+    beginHostPhase();
+    loadProgram(programPaths[0]);
+    endHostPhase(PHASE_ASSEMBLY);
+    if (memoCacheEntries > 0)
+    {
+        runMemoized();
+    }
+    else
+    {
+        runProgram();
+    }
+
+    if (profileOutputPath != NULL)
+    {
+        writeProfile(profileOutputPath);
+    }
+    if (hostCountersEnabled)
+    {
+        printHostCounters();
+    }
+    if (expectedStatePath != NULL && checkExpectedState(expectedStatePath, &regFile, 1) == false)
+    {
+        return 1;
+    }
 }
+#endif